@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/sockios.h>
+#include <linux/ethtool.h>
+#include "plget.h"
+#include "rx_lat.h"
+#include "coal.h"
+
+/* packets handled in one irq have s/w ts closer than this */
+#define COAL_GAP_NS			2000
+
+/* batches of packets handled in one irq */
+struct coal_batches {
+	struct stats_hist wait;		/* first packet on wire -> irq */
+	struct stats_hist delay;	/* every packet on wire -> irq */
+	struct stats_hist period;	/* irq -> irq, of batches > 1 */
+	__u64 num;
+	__u64 pkts;
+	int size_max;
+	int hw;
+};
+
+/* one setting of sweep */
+struct coal_res {
+	__u32 usecs;
+	__u64 pkts;
+	double pps;
+	double batch;		/* packets per irq */
+	double eff;		/* effective rx-usecs */
+	double lat_p50;
+	double lat_p99;
+	double lat_max;
+};
+
+static struct coal_batches batches;
+static struct coal_res res[COAL_SWEEP_MAX];
+static int res_num;
+static int res_hw;
+
+/* copies for signal handler, plget is per thread */
+static struct ethtool_coalesce coal_orig;
+static struct ifreq coal_ifr;
+static int coal_fd = -1;
+
+static int coal_ioctl(struct ethtool_coalesce *ec, __u32 cmd)
+{
+	ec->cmd = cmd;
+	coal_ifr.ifr_data = (char *)ec;
+
+	return ioctl(coal_fd, SIOCETHTOOL, &coal_ifr);
+}
+
+/* time packet waited for irq is counted from its arrival on wire */
+static void coal_batch(struct coal_batches *b, __u64 *sw, __u64 *hw,
+		       int start, int end, __s64 *prev)
+{
+	__s64 irq = sw[start];
+	__s64 delay;
+	int i, size = end - start;
+
+	b->num++;
+	b->pkts += size;
+	if (size > b->size_max)
+		b->size_max = size;
+
+	/* s/w ts are in id order, reordered packet can go before previous */
+	if (size > 1 && *prev && irq > *prev)
+		stats_hist_add(&b->period, irq - *prev);
+
+	*prev = size > 1 ? irq : 0;
+	if (!hw)
+		return;
+
+	delay = irq - hw[start];
+	stats_hist_add(&b->wait, delay > 0 ? delay : 0);
+	for (i = start; i < end; i++) {
+		delay = irq - hw[i];
+		stats_hist_add(&b->delay, delay > 0 ? delay : 0);
+	}
+}
+
+/* split packets to batches by gaps of s/w ts, h/w ts are used if present */
+static void coal_analyze(struct stats *sw, struct stats *hw,
+			 struct coal_batches *b)
+{
+	__u64 *sv = sw->start_ts, *hv = hw->start_ts;
+	int i, start = 0, n = sw->next_ts - sw->start_ts;
+	__s64 prev = 0;
+
+	b->num = 0;
+	b->pkts = 0;
+	b->size_max = 0;
+	b->hw = 0;
+	stats_hist_reset(&b->wait);
+	stats_hist_reset(&b->delay);
+	stats_hist_reset(&b->period);
+	if (!n || !*sv)
+		return;
+
+	b->hw = hv && hw->next_ts - hv == n && *hv;
+	for (i = 1; i <= n; i++) {
+		if (i < n && sv[i] - sv[i - 1] < COAL_GAP_NS)
+			continue;
+
+		coal_batch(b, sv, b->hw ? hv : NULL, start, i, &prev);
+		start = i;
+	}
+}
+
+/*
+ * W/o h/w ts irq period of busy traffic is the best guess, in us, negative
+ * if there is no batch to guess by.
+ */
+static double coal_eff_usecs(struct coal_batches *b)
+{
+	struct stats_hist *h = b->hw ? &b->wait : &b->period;
+
+	if (!h->num)
+		return -1;
+
+	return stats_hist_pct(h, 50) / 1000.0;
+}
+
+static int coal_init(void)
+{
+	struct coal_batches *b = &batches;
+
+	if (b->wait.cnt)
+		return 0;
+
+	if (stats_hist_init(&b->wait, plget->hist_bits) ||
+	    stats_hist_init(&b->delay, plget->hist_bits) ||
+	    stats_hist_init(&b->period, plget->hist_bits))
+		return -ENOMEM;
+
+	return 0;
+}
+
+void coal_print(struct stats *sw, struct stats *hw)
+{
+	struct coal_batches *b = &batches;
+	double eff;
+
+	if (coal_init())
+		return;
+
+	coal_analyze(sw, hw, b);
+	if (!b->num)
+		return;
+
+	printf("\ninterrupt coalescing (packets of one irq have s/w ts "
+	       "closer than %dns):\n", COAL_GAP_NS);
+	printf("batches %llu, packets per batch avg %.2f max %d\n", b->num,
+	       (double)b->pkts / b->num, b->size_max);
+
+	if (b->hw)
+		printf("induced delay, us (wire -> irq): p50/p99/max = "
+		       "%.3f/%.3f/%.3f\n",
+		       stats_hist_pct(&b->delay, 50) / 1000.0,
+		       stats_hist_pct(&b->delay, 99) / 1000.0,
+		       b->delay.max / 1000.0);
+
+	eff = coal_eff_usecs(b);
+	if (eff < 0)
+		printf("effective rx-usecs: unknown, no batches > 1 w/o h/w "
+		       "ts\n");
+	else
+		printf("effective rx-usecs: ~%.1f (%s)\n", eff,
+		       b->hw ? "median of first packet wire -> irq" :
+			       "median irq period of batches > 1, w/o h/w ts");
+}
+
+/* latency of app from wire, or from net subsystem w/o h/w ts */
+static void coal_record(struct coal_res *r)
+{
+	struct stats *v = stats_correct_id(&rx_hw_v, 0) ? &rx_hw_v :
+							  &rx_sw_v;
+	struct stats_hist *h = &batches.delay;
+	__u64 *ts, n;
+
+	coal_analyze(&rx_sw_v, &rx_hw_v, &batches);
+	r->pkts = batches.pkts;
+	r->batch = batches.num ? (double)batches.pkts / batches.num : 0;
+	r->eff = coal_eff_usecs(&batches);
+	res_hw = batches.hw;
+
+	n = rx_sw_v.next_ts - rx_sw_v.start_ts;
+	if (n > 1)
+		r->pps = (double)(n - 1) * NSEC_PER_SEC /
+			 (*(rx_sw_v.next_ts - 1) - *rx_sw_v.start_ts);
+
+	/* analysis is done, its histogram is reused for latency */
+	stats_hist_reset(h);
+	stats_diff(&rx_app_v, v, &temp);
+	for (ts = temp.start_ts; ts < temp.next_ts; ts++)
+		stats_hist_add(h, *ts);
+
+	r->lat_p50 = stats_hist_pct(h, 50) / 1000.0;
+	r->lat_p99 = stats_hist_pct(h, 99) / 1000.0;
+	r->lat_max = h->max / 1000.0;
+}
+
+/* packets queued with previous setting are not counted */
+static void coal_drain(void)
+{
+	char buf[64];
+
+	while (recv(plget->sfd, buf, sizeof(buf),
+		    MSG_DONTWAIT | MSG_TRUNC) >= 0)
+		;
+}
+
+/* original setting is restored if sweep is interrupted */
+static void coal_sig_restore(int sig)
+{
+	coal_ioctl(&coal_orig, ETHTOOL_SCOALESCE);
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+static int coal_sweep_init(void)
+{
+	struct sigaction sa;
+
+	coal_fd = plget->sfd;
+	memset(&coal_ifr, 0, sizeof(coal_ifr));
+	snprintf(coal_ifr.ifr_name, sizeof(coal_ifr.ifr_name), "%s",
+		 plget->if_name);
+
+	memset(&coal_orig, 0, sizeof(coal_orig));
+	if (coal_ioctl(&coal_orig, ETHTOOL_GCOALESCE))
+		return perror("Couldn't get interrupt coalescing"), -errno;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = coal_sig_restore;
+	if (sigaction(SIGINT, &sa, NULL) || sigaction(SIGTERM, &sa, NULL))
+		return perror("Couldn't set restore handler"), -errno;
+
+	return 0;
+}
+
+/* rx-lat is run for every rx-usecs, each on own -n packets */
+int coal_sweep(void)
+{
+	struct ethtool_coalesce ec;
+	int i, ret;
+
+	ret = coal_init();
+	if (ret)
+		return ret;
+
+	ret = coal_sweep_init();
+	if (ret)
+		return ret;
+
+	printf("rx-usecs %u, adaptive %s, sweeping:\n",
+	       coal_orig.rx_coalesce_usecs,
+	       coal_orig.use_adaptive_rx_coalesce ? "on" : "off");
+
+	for (i = 0; i < plget->coal_num; i++) {
+		ec = coal_orig;
+		ec.rx_coalesce_usecs = plget->coal_usecs[i];
+		ec.use_adaptive_rx_coalesce = 0;
+		if (coal_ioctl(&ec, ETHTOOL_SCOALESCE)) {
+			ret = -errno;
+			perror("Couldn't set interrupt coalescing");
+			break;
+		}
+
+		printf("rx-usecs %u...\n", ec.rx_coalesce_usecs);
+		fflush(stdout);
+
+		coal_drain();
+		rxlat_reset();
+		ret = rxlat();
+		if (ret)
+			break;
+
+		res[res_num].usecs = ec.rx_coalesce_usecs;
+		coal_record(&res[res_num++]);
+	}
+
+	if (coal_ioctl(&coal_orig, ETHTOOL_SCOALESCE))
+		return perror("Couldn't restore interrupt coalescing"), -errno;
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	printf("rx-usecs %u restored\n", coal_orig.rx_coalesce_usecs);
+	return ret;
+}
+
+void coal_sweep_print(void)
+{
+	struct coal_res *r;
+	int i;
+
+	if (!res_num)
+		return;
+
+	printf("interrupt coalescing sweep, latency is %s -> app, us:\n",
+	       res_hw ? "wire" : "net subsystem");
+	printf("%10s|%10s|%12s|%10s|%14s|%10s|%10s|%10s\n", "rx-usecs",
+	       "packets", "pps", "batch", "eff rx-usecs", "lat p50",
+	       "lat p99", "lat max");
+
+	for (i = 0; i < res_num; i++) {
+		r = &res[i];
+		printf("%10u|%10llu|%12.1f|%10.2f|", r->usecs, r->pkts, r->pps,
+		       r->batch);
+		r->eff < 0 ? printf("%14s|", "-") : printf("%14.1f|", r->eff);
+		printf("%10.3f|%10.3f|%10.3f\n", r->lat_p50, r->lat_p99,
+		       r->lat_max);
+	}
+
+	printf("\n");
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PLGET_COAL_H
+#define PLGET_COAL_H
+
+#include "stat.h"
+
+/*
+ * Interrupt coalescing, see -o coal and -W. Packets handled in one irq are
+ * found by gaps of their s/w ts, h/w ts gives delay irq induces.
+ */
+void coal_print(struct stats *sw, struct stats *hw);
+int coal_sweep(void);
+void coal_sweep_print(void);
+
+#endif
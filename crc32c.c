@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include "crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#include <arm_acle.h>
+#endif
+
+#define CRC32C_POLY			0x82f63b78	/* reflected */
+
+static __u32 crc32c_tbl[8][256];
+
+static __u32 crc32c_sw(__u32 crc, const __u8 *p, size_t len)
+{
+	__u32 lo, hi;
+
+	for (; len && ((unsigned long)p & 7); len--)
+		crc = crc32c_tbl[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	/* slicing-by-8, little endian words */
+	for (; len >= 8; len -= 8, p += 8) {
+		lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | (__u32)p[3] << 24);
+		hi = p[4] | p[5] << 8 | p[6] << 16 | (__u32)p[7] << 24;
+
+		crc = crc32c_tbl[7][lo & 0xff] ^
+		      crc32c_tbl[6][(lo >> 8) & 0xff] ^
+		      crc32c_tbl[5][(lo >> 16) & 0xff] ^
+		      crc32c_tbl[4][lo >> 24] ^
+		      crc32c_tbl[3][hi & 0xff] ^
+		      crc32c_tbl[2][(hi >> 8) & 0xff] ^
+		      crc32c_tbl[1][(hi >> 16) & 0xff] ^
+		      crc32c_tbl[0][hi >> 24];
+	}
+
+	while (len--)
+		crc = crc32c_tbl[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static __u32 crc32c_hw(__u32 crc, const __u8 *p, size_t len)
+{
+	__u64 crc64 = crc, v;
+
+	for (; len && ((unsigned long)p & 7); len--)
+		crc64 = _mm_crc32_u8(crc64, *p++);
+
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&v, p, sizeof(v));
+		crc64 = _mm_crc32_u64(crc64, v);
+	}
+
+	while (len--)
+		crc64 = _mm_crc32_u8(crc64, *p++);
+
+	return crc64;
+}
+
+static int crc32c_hw_present(void)
+{
+	return __builtin_cpu_supports("sse4.2");
+}
+#elif defined(__aarch64__)
+__attribute__((target("+crc")))
+static __u32 crc32c_hw(__u32 crc, const __u8 *p, size_t len)
+{
+	__u64 v;
+
+	for (; len && ((unsigned long)p & 7); len--)
+		crc = __crc32cb(crc, *p++);
+
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&v, p, sizeof(v));
+		crc = __crc32cd(crc, v);
+	}
+
+	while (len--)
+		crc = __crc32cb(crc, *p++);
+
+	return crc;
+}
+
+static int crc32c_hw_present(void)
+{
+	return !!(getauxval(AT_HWCAP) & HWCAP_CRC32);
+}
+#else
+#define crc32c_hw			crc32c_sw
+
+static int crc32c_hw_present(void)
+{
+	return 0;
+}
+#endif
+
+static __u32 (*crc32c_fn)(__u32 crc, const __u8 *p, size_t len) = crc32c_sw;
+
+const char *crc32c_init(void)
+{
+	__u32 crc;
+	int i, j;
+
+	if (crc32c_hw_present()) {
+		crc32c_fn = crc32c_hw;
+		return "h/w";
+	}
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+
+		crc32c_tbl[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < 8; j++)
+			crc32c_tbl[j][i] = crc32c_tbl[0][crc32c_tbl[j - 1][i] &
+							 0xff] ^
+					   (crc32c_tbl[j - 1][i] >> 8);
+
+	crc32c_fn = crc32c_sw;
+	return "s/w";
+}
+
+__u32 crc32c(const void *data, size_t len)
+{
+	return ~crc32c_fn(~0U, data, len);
+}
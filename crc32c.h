@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PLGET_CRC32C_H
+#define PLGET_CRC32C_H
+
+#include <linux/types.h>
+#include <stddef.h>
+
+#define CRC_LEN				4
+
+/*
+ * Select crc32c implementation, cpu crc instructions are used if present
+ * (sse4.2 on x86, crc extension on arm64), otherwise slicing-by-8 table.
+ * Returns name of selected one.
+ */
+const char *crc32c_init(void);
+
+/* crc32c (Castagnoli) of data, as in iSCSI and SCTP */
+__u32 crc32c(const void *data, size_t len);
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PLGET_CSUM_H
+#define PLGET_CSUM_H
+
+#include <linux/types.h>
+
+/*
+ * csum_add - add data to partial internet checksum
+ * @off - offset of data in checksummed area, defines byte position in word
+ */
+static inline __u32 csum_add(__u32 sum, const void *data, int len, int off)
+{
+	const __u8 *p = data;
+	int i;
+
+	for (i = 0; i < len; i++, off++)
+		sum += (off & 1) ? p[i] : p[i] << 8;
+
+	return sum;
+}
+
+/* fold partial sum to 16 bit checksum, host order */
+static inline __u16 csum_fold(__u32 sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum;
+}
+
+/* update checksum for replaced field, RFC 1624, len has to be even */
+static inline __u16 csum_replace(__u16 csum, const void *from, const void *to,
+				 int len)
+{
+	const __u8 *f = from, *t = to;
+	__u32 sum = (__u16)~csum;
+	int i;
+
+	for (i = 0; i < len; i += 2) {
+		sum += 0xffff - ((f[i] << 8) | f[i + 1]);
+		sum += (t[i] << 8) | t[i + 1];
+	}
+
+	return csum_fold(sum);
+}
+
+#endif
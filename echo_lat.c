@@ -26,9 +26,75 @@
 #include "echo_lat.h"
 #include <poll.h>
 #include <errno.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <netinet/ip6.h>
 
 #define MAX_LATENCY			5000
 
+static void echolat_swap_iaddr6(void)
+{
+	struct in6_addr saddr, daddr;
+	struct ip6_hdr *ip6h;
+	struct udphdr *udph;
+	__u16 csum;
+
+	ip6h = (struct ip6_hdr *)(plget->pkt + plget->rx_l3_off);
+	udph = (struct udphdr *)(plget->pkt + plget->rx_l4_off);
+
+	saddr = ip6h->ip6_src;
+	daddr = ip6h->ip6_dst;
+	if (!IN6_IS_ADDR_MULTICAST(&daddr)) {
+		ip6h->ip6_src = daddr;
+		ip6h->ip6_dst = saddr;
+		return;
+	}
+
+	ip6h->ip6_src = plget->if_iaddr6;
+	csum = csum_replace(ntohs(udph->check), &saddr, &ip6h->ip6_src,
+			    sizeof(saddr));
+	udph->check = htons(csum ? csum : 0xffff);
+}
+
+/*
+ * Echo raw udp frame back to its source, or to the same mcast group.
+ * Swapping addresses doesn't change csums, replacing source does.
+ */
+static void echolat_swap_iaddr(void)
+{
+	struct udphdr *udph;
+	struct iphdr *iph;
+	__u32 saddr, daddr;
+	__u16 csum;
+
+	if (plget->flags & PLF_IPV6)
+		return echolat_swap_iaddr6();
+
+	iph = (struct iphdr *)(plget->pkt + plget->rx_l3_off);
+	udph = (struct udphdr *)(plget->pkt + plget->rx_l4_off);
+
+	saddr = iph->saddr;
+	daddr = iph->daddr;
+	if (!IN_MULTICAST(ntohl(daddr))) {
+		iph->saddr = daddr;
+		iph->daddr = saddr;
+		return;
+	}
+
+	iph->saddr = plget->if_iaddr.s_addr;
+	csum = csum_replace(ntohs(iph->check), &saddr, &iph->saddr,
+			    sizeof(saddr));
+	iph->check = htons(csum);
+
+	/* zero udp csum means no csum for ipv4 */
+	if (!udph->check)
+		return;
+
+	csum = csum_replace(ntohs(udph->check), &saddr, &iph->saddr,
+			    sizeof(saddr));
+	udph->check = htons(csum ? csum : 0xffff);
+}
+
 static int echolat_proc(void)
 {
 	struct ether_addr *dst_addr, *src_addr;
@@ -67,6 +133,9 @@ static int echolat_proc(void)
 				*dst_addr = *src_addr;
 
 			*src_addr = plget->if_addr;
+
+			if (plget->flags & PLF_RAW_UDP)
+				echolat_swap_iaddr();
 		}
 
 		if (timer) {
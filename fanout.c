@@ -0,0 +1,416 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+#include "fanout.h"
+#include "rx_lat.h"
+#include "rx_ring.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+/* how often main thread checks rx-lat workers progress */
+#define FANOUT_POLL_US		1000
+
+struct rx_worker {
+	struct plgett pl;	/* worker's copy of plget */
+	struct rxrate_sum sum;
+	struct stats app_v;	/* rx vectors saved on worker exit */
+	struct stats sw_v;
+	struct stats hw_v;
+	struct stats snd_v;
+	struct stats_hist lat_h[RX_STAGE_NUM];
+	pthread_t thd;
+	int cpu;
+	int ready;		/* socket is created and joined */
+	int done;
+	int ret;
+};
+
+static struct rx_worker *workers;
+
+/*
+ * udp sockets are in one SO_REUSEPORT group already, in cpu mode steer
+ * packets to socket index equal to cpu packet is received on, it's the
+ * worker pinned to this cpu as workers join the group in order.
+ */
+static int fanout_reuseport_cbpf(int sfd)
+{
+	struct sock_filter code[] = {
+		{ BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, plget->fanout_num },
+		{ BPF_RET | BPF_A, 0, 0, 0 },
+	};
+	struct sock_fprog prog;
+	int ret;
+
+	if (plget->fanout_mode != PACKET_FANOUT_CPU)
+		return 0;
+
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+	ret = setsockopt(sfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+			 sizeof(prog));
+	if (ret < 0)
+		return perror("Couldn't attach reuseport cbpf"), -errno;
+
+	return 0;
+}
+
+static int fanout_join(int sfd)
+{
+	int val = plget->fanout_mode << 16 | (getpid() & 0xffff);
+	int ret;
+
+	if (plget->pkt_type == PKT_UDP)
+		return fanout_reuseport_cbpf(sfd);
+
+	ret = setsockopt(sfd, SOL_PACKET, PACKET_FANOUT, &val, sizeof(val));
+	if (ret < 0)
+		return perror("Couldn't join fanout group"), -errno;
+
+	return 0;
+}
+
+/* vectors are thread local, so save them before thread is gone */
+static void fanout_worker_exit(void *arg)
+{
+	struct rx_worker *w = arg;
+
+	w->app_v = rx_app_v;
+	w->sw_v = rx_sw_v;
+	w->hw_v = rx_hw_v;
+	w->snd_v = rx_snd_v;
+	memcpy(w->lat_h, rx_lat_h, sizeof(w->lat_h));
+	__atomic_store_n(&w->done, 1, __ATOMIC_RELEASE);
+}
+
+static int fanout_reserve(struct stats *ss)
+{
+	size_t size = plget->pkt_num * sizeof(*ss->start_ts);
+
+	/* zeroed to find out later what ids are received by the worker */
+	ss->start_ts = calloc(1, size);
+	if (!ss->start_ts)
+		return -ENOMEM;
+
+	ss->next_ts = ss->start_ts;
+	ss->num = plget->pkt_num;
+	return 0;
+}
+
+static int fanout_worker_init(void)
+{
+	int ret;
+
+	ret = plget_init_worker();
+	if (ret)
+		return ret;
+
+	ret = fanout_join(plget->sfd);
+	if (ret)
+		return ret;
+
+	if (plget->mod != RX_LAT || !(plget->flags & PLF_PRINTOUT))
+		return 0;
+
+	if (plget->flags & PLF_HIST) {
+		if (rxlat_hist_init())
+			return perror("Cannot allocate worker histograms"),
+			       -ENOMEM;
+		return 0;
+	}
+
+	if (fanout_reserve(&rx_app_v) || fanout_reserve(&rx_sw_v) ||
+	    fanout_reserve(&rx_hw_v) ||
+	    (plget->flags & PLF_TX_TS && fanout_reserve(&rx_snd_v)))
+		return perror("Cannot allocate worker stats"), -ENOMEM;
+
+	return 0;
+}
+
+static void *fanout_worker(void *arg)
+{
+	struct rx_worker *w = arg;
+	sigset_t set;
+
+	/* ctrl-c ends rx-rate in main thread with summary */
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	plget = &w->pl;
+	pthread_cleanup_push(fanout_worker_exit, w);
+
+	w->ret = fanout_worker_init();
+	__atomic_store_n(&w->ready, 1, __ATOMIC_RELEASE);
+	if (!w->ret) {
+		if (plget->mod == RX_LAT)
+			w->ret = rxlat();
+		else
+			w->ret = rxrate_worker(&w->sum);
+	}
+
+	pthread_cleanup_pop(1);
+	return NULL;
+}
+
+static int fanout_start(void)
+{
+	int i, ret, ncpu;
+	pthread_attr_t attr;
+	struct rx_worker *w;
+	cpu_set_t cpus;
+
+	workers = calloc(plget->fanout_num, sizeof(*workers));
+	if (!workers)
+		return -ENOMEM;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu <= 0)
+		ncpu = 1;
+
+	/* socket of main thread is not needed, workers create own ones */
+	if (plget->flags & PLF_RX_RING)
+		rx_ring_release();
+
+	close(plget->sfd);
+	if (plget->flags & PLF_EPOLL)
+		close(plget->epfd);
+
+	for (i = 0; i < plget->fanout_num; i++) {
+		w = &workers[i];
+		w->pl = *plget;
+		w->cpu = i % ncpu;
+		pthread_mutex_init(&w->sum.lock, NULL);
+
+		CPU_ZERO(&cpus);
+		CPU_SET(w->cpu, &cpus);
+		pthread_attr_init(&attr);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+		ret = pthread_create(&w->thd, &attr, fanout_worker, w);
+		pthread_attr_destroy(&attr);
+		if (ret) {
+			errno = ret;
+			return perror("Cannot create fanout worker"), -ret;
+		}
+
+		/* join the group one by one to keep order of sockets */
+		while (!__atomic_load_n(&w->ready, __ATOMIC_ACQUIRE))
+			usleep(FANOUT_POLL_US);
+	}
+
+	return 0;
+}
+
+static void fanout_stop(void)
+{
+	int i;
+
+	for (i = 0; i < plget->fanout_num; i++) {
+		if (!__atomic_load_n(&workers[i].done, __ATOMIC_ACQUIRE))
+			pthread_cancel(workers[i].thd);
+	}
+
+	for (i = 0; i < plget->fanout_num; i++)
+		pthread_join(workers[i].thd, NULL);
+}
+
+/* put timestamps received by workers in rx vectors of main thread */
+static void fanout_merge(void)
+{
+	struct rx_worker *w = NULL;
+	__u32 id;
+	int i, j;
+
+	if (plget->flags & PLF_HIST) {
+		for (i = 0; i < plget->fanout_num; i++)
+			for (j = 0; j < RX_STAGE_NUM; j++)
+				stats_hist_merge(&rx_lat_h[j],
+						 &workers[i].lat_h[j]);
+		return;
+	}
+
+	for (id = 0; id < plget->pkt_num; id++) {
+		for (i = 0; i < plget->fanout_num; i++) {
+			w = &workers[i];
+			if (w->app_v.start_ts && stats_correct_id(&w->app_v, id))
+				break;
+		}
+
+		if (i == plget->fanout_num)
+			continue;
+
+		stats_push_ns_id(&rx_app_v, w->app_v.start_ts[id], id);
+		stats_push_ns_id(&rx_sw_v, w->sw_v.start_ts[id], id);
+		stats_push_ns_id(&rx_hw_v, w->hw_v.start_ts[id], id);
+		if (plget->flags & PLF_TX_TS)
+			stats_push_ns_id(&rx_snd_v, w->snd_v.start_ts[id], id);
+		plget->sk_payload_size = w->pl.sk_payload_size;
+	}
+}
+
+static int fanout_rxlat(void)
+{
+	unsigned long cnt, last = 0;
+	int i, done, ret = 0;
+	struct rx_worker *w;
+	__u64 idle_us = 0;
+
+	plget->inum = plget->pkt_num;
+	for (;;) {
+		cnt = 0;
+		done = 1;
+		for (i = 0; i < plget->fanout_num; i++) {
+			cnt += __atomic_load_n(&workers[i].pl.icnt,
+					       __ATOMIC_RELAXED);
+			done &= __atomic_load_n(&workers[i].done,
+						__ATOMIC_ACQUIRE);
+		}
+
+		plget->icnt = cnt;
+		if (cnt >= plget->pkt_num || done)
+			break;
+
+		/* no new packets for idle timeout, first one including */
+		idle_us = cnt == last ? idle_us + FANOUT_POLL_US : 0;
+		last = cnt;
+		if (plget->idle_timeout &&
+		    idle_us >= plget->idle_timeout * 1000ULL) {
+			plget->rx_idle = 1;
+			break;
+		}
+
+		usleep(FANOUT_POLL_US);
+	}
+
+	fanout_stop();
+
+	for (i = 0; i < plget->fanout_num; i++) {
+		w = &workers[i];
+		printf("worker %d, cpu %d: %lu packets\n", i, w->cpu,
+		       w->pl.icnt);
+		plget->spin_cnt += w->pl.spin_cnt;
+		plget->block_cnt += w->pl.block_cnt;
+		plget->rx_seq.dup += w->pl.rx_seq.dup;
+		plget->rx_seq.invalid += w->pl.rx_seq.invalid;
+		plget->rx_seq.corrupt += w->pl.rx_seq.corrupt;
+		plget->rx_seq.reorder += w->pl.rx_seq.reorder;
+		plget->rx_seq.late += w->pl.rx_seq.late;
+		if (w->pl.rx_seq.reorder_max > plget->rx_seq.reorder_max)
+			plget->rx_seq.reorder_max = w->pl.rx_seq.reorder_max;
+
+		if (w->ret)
+			ret = w->ret;
+	}
+
+	if (plget->flags & PLF_PRINTOUT) {
+		fanout_merge();
+		rxlat_compact();
+	}
+
+	return ret;
+}
+
+static int fanout_rxrate(void)
+{
+	struct timespec prev, now, interval;
+	unsigned int drops;
+	struct rx_worker *w;
+	uint64_t exps;
+	__u64 pnum;
+	int i, ret;
+
+	ret = init_rxrate();
+	if (ret)
+		return ret;
+
+	ret = rxrate_fanout_init();
+	if (ret)
+		goto out;
+
+	ret = plget_start_timer();
+	if (ret)
+		goto out;
+
+	clock_gettime(CLOCK_MONOTONIC, &prev);
+	while (!rxrate_stopped()) {
+		ret = read(plget->timer_fd, &exps, sizeof(uint64_t));
+		if (ret < 0 && errno == EINTR)
+			continue;
+
+		if (ret < 0) {
+			ret = -errno;
+			perror("Couldn't read timerfd");
+			break;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		ts_sub(&now, &prev, &interval);
+		prev = now;
+
+		drops = 0;
+		for (i = 0; i < plget->fanout_num; i++) {
+			w = &workers[i];
+			if (__atomic_load_n(&w->done, __ATOMIC_ACQUIRE)) {
+				ret = w->ret;
+				goto stop;
+			}
+
+			pnum = rxrate_fanout_take(&w->sum);
+			printf("worker %d, cpu %d: PPS = %.1f\n", i, w->cpu,
+			       (double)pnum * NSEC_PER_SEC / ts_ns(&interval));
+
+			if (plget->flags & PLF_RX_RING)
+				drops += rx_ring_drops(w->pl.sfd);
+		}
+
+		rxrate_fanout_print();
+		if (drops)
+			printf("DROPPED BY SOCKET = %u\n", drops);
+	}
+
+	ret = 0;
+stop:
+	fanout_stop();
+	rxrate_fanout_done();
+out:
+	close(plget->timer_fd);
+	return ret;
+}
+
+/*
+ * One socket per worker, packet sockets are joined to one PACKET_FANOUT
+ * group and udp ones share the port with SO_REUSEPORT.
+ */
+int fanout(void)
+{
+	int ret;
+
+	ret = fanout_start();
+	if (ret)
+		return ret;
+
+	if (plget->mod == RX_LAT)
+		return fanout_rxlat();
+
+	return fanout_rxrate();
+}
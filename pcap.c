@@ -0,0 +1,421 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+#include "plget.h"
+#include "pcap.h"
+
+#define PCAP_RING_NUM			4096	/* power of 2 */
+#define PCAP_POLL_US			1000
+#define PCAP_HLEN_MAX			64	/* synthesized headers */
+#define PCAP_OPT_MAX			128
+#define PCAP_BLOCK_MAX			(32 + PCAP_HLEN_MAX + PCAP_SNAPLEN + \
+					 PCAP_OPT_MAX)
+
+#define PCAPNG_SHB			0x0a0d0d0a
+#define PCAPNG_IDB			0x00000001
+#define PCAPNG_EPB			0x00000006
+#define PCAPNG_BYTE_ORDER		0x1a2b3c4d
+
+#define PCAPNG_OPT_END			0
+#define PCAPNG_OPT_COMMENT		1
+#define PCAPNG_IF_NAME			2
+#define PCAPNG_IF_TSRESOL		9
+#define PCAPNG_EPB_FLAGS		2
+#define PCAPNG_EPB_PACKETID		5
+
+#define PCAPNG_FLAG_INBOUND		1
+#define PCAPNG_FLAG_OUTBOUND		2
+
+#define LINKTYPE_ETHERNET		1
+#define LINKTYPE_RAW			101
+
+/* interfaces of section */
+#define PCAP_IF_RX			0
+#define PCAP_IF_TX			1
+
+enum {
+	PCAP_TS_APP,
+	PCAP_TS_SW,
+	PCAP_TS_HW,
+	PCAP_TS_NUM
+};
+
+static const char * const pcap_ts_names[PCAP_TS_NUM] = {"app", "sw", "hw"};
+
+struct pcap_slot {
+	__u64 ts[PCAP_TS_NUM];		/* ns, zero if not known */
+	__u32 id;
+	__u16 caplen;
+	__u16 len;
+	int ifid;
+	char data[];
+};
+
+/*
+ * Single producer ring, slots are preallocated. Producer only copies frame
+ * and moves head, writer thread moves tail after slot is written to file.
+ */
+struct pcap_ring {
+	char *slots;
+	int slot_size;
+	int snaplen;
+	unsigned long drops;		/* ring was full */
+	unsigned long frames;
+	unsigned int head __attribute__((aligned(64)));
+	unsigned int tail __attribute__((aligned(64)));
+	int stop;
+};
+
+static struct pcap_ring ring;
+static pthread_t pcap_thd;
+static FILE *pcap_file;
+static int pcap_err;
+static const char *pcap_path;
+
+/*
+ * Socket w/o link layer doesn't give headers, so they are synthesized for
+ * standard tools, addresses which are not known are zero, only multicast
+ * group of udp is.
+ */
+static char rx_hdr[PCAP_HLEN_MAX];
+static int rx_hlen;
+static int rx_udp;
+
+static void pcap_slot_push(int ifid, const char *pkt, int len, __u64 app,
+			   __u64 sw, __u64 hw, __u32 id)
+{
+	unsigned int head = ring.head;
+	struct pcap_slot *s;
+
+	if (head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) ==
+	    PCAP_RING_NUM) {
+		ring.drops++;
+		return;
+	}
+
+	s = (struct pcap_slot *)(ring.slots +
+				 (head & (PCAP_RING_NUM - 1)) * ring.slot_size);
+	s->ts[PCAP_TS_APP] = app;
+	s->ts[PCAP_TS_SW] = sw;
+	s->ts[PCAP_TS_HW] = hw;
+
+	s->id = id;
+	s->ifid = ifid;
+	s->len = len;
+	s->caplen = len < ring.snaplen ? len : ring.snaplen;
+	memcpy(s->data, pkt, s->caplen);
+
+	__atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+}
+
+void pcap_rx(const char *pkt, int len, __u64 app, __u64 sw, __u64 hw,
+	     __u32 id)
+{
+	pcap_slot_push(PCAP_IF_RX, pkt, len, app, sw, hw, id);
+}
+
+void pcap_tx(const char *pkt, int len, __u64 sw, __u64 hw, __u32 id)
+{
+	pcap_slot_push(PCAP_IF_TX, pkt, len, 0, sw, hw, id);
+}
+
+/* add option to block, value is padded to 32 bits */
+static char *pcap_opt(char *p, __u16 code, const void *val, __u16 len)
+{
+	memcpy(p, &code, sizeof(code));
+	memcpy(p + 2, &len, sizeof(len));
+	memcpy(p + 4, val, len);
+	p += 4 + len;
+
+	for (; len & 3; len++)
+		*p++ = 0;
+
+	return p;
+}
+
+/* write block with total length in the head and in the tail */
+static int pcap_block_write(char *b, char *end, __u32 type)
+{
+	__u32 blen = end - b + sizeof(blen);
+
+	memcpy(b, &type, sizeof(type));
+	memcpy(b + 4, &blen, sizeof(blen));
+	memcpy(end, &blen, sizeof(blen));
+
+	return fwrite(b, blen, 1, pcap_file) == 1 ? 0 : -EIO;
+}
+
+static int pcap_shb_write(void)
+{
+	char b[32], *p = b + 8;
+	__u32 magic = PCAPNG_BYTE_ORDER;
+	__u16 ver[2] = {1, 0};
+	__s64 slen = -1;
+
+	memcpy(p, &magic, sizeof(magic));
+	memcpy(p + 4, ver, sizeof(ver));
+	memcpy(p + 8, &slen, sizeof(slen));
+	p += 16;
+
+	return pcap_block_write(b, p, PCAPNG_SHB);
+}
+
+static int pcap_idb_write(__u16 linktype, __u32 snaplen)
+{
+	char b[64 + IFNAMSIZ], *p = b + 8;
+	__u8 tsresol = 9;	/* ns */
+	__u16 rsvd = 0;
+
+	memcpy(p, &linktype, sizeof(linktype));
+	memcpy(p + 2, &rsvd, sizeof(rsvd));
+	memcpy(p + 4, &snaplen, sizeof(snaplen));
+	p += 8;
+
+	p = pcap_opt(p, PCAPNG_IF_NAME, plget->if_name,
+		     strlen(plget->if_name));
+	p = pcap_opt(p, PCAPNG_IF_TSRESOL, &tsresol, sizeof(tsresol));
+	p = pcap_opt(p, PCAPNG_OPT_END, NULL, 0);
+
+	return pcap_block_write(b, p, PCAPNG_IDB);
+}
+
+/* lengths of synthesized ip and udp headers are set per frame */
+static void pcap_udp_hdr_set(char *hdr, int len)
+{
+	struct udphdr *udph;
+	struct ip6_hdr *ip6h;
+	struct iphdr *iph;
+
+	if (rx_udp == AF_INET6) {
+		ip6h = (struct ip6_hdr *)hdr;
+		udph = (struct udphdr *)(ip6h + 1);
+		ip6h->ip6_plen = htons(len + sizeof(*udph));
+	} else {
+		iph = (struct iphdr *)hdr;
+		udph = (struct udphdr *)(iph + 1);
+		iph->tot_len = htons(len + rx_hlen);
+		iph->check = 0;
+		iph->check = htons(csum_fold(csum_add(0, iph, sizeof(*iph),
+						      0)));
+	}
+
+	udph->len = htons(len + sizeof(*udph));
+}
+
+static int pcap_epb_write(struct pcap_slot *s)
+{
+	static char b[PCAP_BLOCK_MAX];
+	char *p = b + 8, cmt[PCAP_OPT_MAX - 32];
+	__u32 flags, hlen = 0, caplen, len;
+	__u64 ns = 0, id = s->id;
+	int i, n;
+
+	if (s->ifid == PCAP_IF_RX)
+		hlen = rx_hlen;
+
+	/* best ts is one of the frame */
+	n = snprintf(cmt, sizeof(cmt), "id %u", s->id);
+	for (i = PCAP_TS_NUM - 1; i >= 0; i--) {
+		if (!s->ts[i])
+			continue;
+
+		if (!ns)
+			ns = s->ts[i];
+
+		n += snprintf(cmt + n, sizeof(cmt) - n, " %s %llu.%09llu",
+			      pcap_ts_names[i], s->ts[i] / NSEC_PER_SEC,
+			      s->ts[i] % NSEC_PER_SEC);
+	}
+
+	caplen = s->caplen + hlen;
+	len = s->len + hlen;
+
+	memcpy(p, &s->ifid, sizeof(__u32));
+	flags = ns >> 32;
+	memcpy(p + 4, &flags, sizeof(flags));
+	flags = ns;
+	memcpy(p + 8, &flags, sizeof(flags));
+	memcpy(p + 12, &caplen, sizeof(caplen));
+	memcpy(p + 16, &len, sizeof(len));
+	p += 20;
+
+	memcpy(p, rx_hdr, hlen);
+	if (hlen && rx_udp)
+		pcap_udp_hdr_set(p, s->len);
+
+	memcpy(p + hlen, s->data, s->caplen);
+	for (p += caplen; caplen & 3; caplen++)
+		*p++ = 0;
+
+	flags = s->ifid == PCAP_IF_RX ? PCAPNG_FLAG_INBOUND :
+					PCAPNG_FLAG_OUTBOUND;
+	p = pcap_opt(p, PCAPNG_EPB_FLAGS, &flags, sizeof(flags));
+	p = pcap_opt(p, PCAPNG_EPB_PACKETID, &id, sizeof(id));
+	p = pcap_opt(p, PCAPNG_OPT_COMMENT, cmt, n);
+	p = pcap_opt(p, PCAPNG_OPT_END, NULL, 0);
+
+	return pcap_block_write(b, p, PCAPNG_EPB);
+}
+
+static void *pcap_writer(void *arg)
+{
+	struct pcap_slot *s;
+	unsigned int head;
+	int stop;
+
+	for (;;) {
+		stop = __atomic_load_n(&ring.stop, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+		if (head == ring.tail) {
+			if (stop)
+				break;
+
+			usleep(PCAP_POLL_US);
+			continue;
+		}
+
+		for (; ring.tail != head; ring.frames++) {
+			s = (struct pcap_slot *)(ring.slots +
+				(ring.tail & (PCAP_RING_NUM - 1)) *
+				ring.slot_size);
+			if (!pcap_err)
+				pcap_err = pcap_epb_write(s);
+
+			__atomic_store_n(&ring.tail, ring.tail + 1,
+					 __ATOMIC_RELEASE);
+		}
+	}
+
+	return NULL;
+}
+
+static void pcap_rx_hdr_init(void)
+{
+	struct ether_header *eth;
+	struct udphdr *udph;
+	struct ip6_hdr *ip6h;
+	struct iphdr *iph;
+
+	memset(rx_hdr, 0, sizeof(rx_hdr));
+	if (plget->pkt_type == PKT_ETH) {
+		eth = (struct ether_header *)rx_hdr;
+		memcpy(eth->ether_dhost, &plget->if_addr, ETH_ALEN);
+		eth->ether_type = htons(plget->flags & PLF_AVTP ? ETH_P_TSN :
+								  ETH_P_1588);
+		rx_hlen = sizeof(*eth);
+		return;
+	}
+
+	if (plget->pkt_type != PKT_UDP)
+		return;
+
+	if (plget->flags & PLF_IPV6) {
+		ip6h = (struct ip6_hdr *)rx_hdr;
+		ip6h->ip6_vfc = 6 << 4;
+		ip6h->ip6_nxt = IPPROTO_UDP;
+		ip6h->ip6_hlim = 64;
+		if (plget_iaddr_mcast())
+			ip6h->ip6_dst = plget->iaddr6;
+		udph = (struct udphdr *)(ip6h + 1);
+		rx_udp = AF_INET6;
+	} else {
+		iph = (struct iphdr *)rx_hdr;
+		iph->version = 4;
+		iph->ihl = sizeof(*iph) >> 2;
+		iph->ttl = 64;
+		iph->protocol = IPPROTO_UDP;
+		if (plget_iaddr_mcast())
+			iph->daddr = plget->iaddr.s_addr;
+		udph = (struct udphdr *)(iph + 1);
+		rx_udp = AF_INET;
+	}
+
+	udph->source = htons(plget->port);
+	udph->dest = htons(plget->port);
+	rx_hlen = (char *)(udph + 1) - rx_hdr;
+}
+
+int pcap_open(const char *path, int snaplen)
+{
+	int ret;
+
+	ring.snaplen = snaplen;
+	ring.slot_size = (sizeof(struct pcap_slot) + snaplen + 63) & ~63;
+	ring.slots = malloc((size_t)ring.slot_size * PCAP_RING_NUM);
+	if (!ring.slots)
+		return perror("Cannot allocate capture ring"), -ENOMEM;
+
+	pcap_file = fopen(path, "w");
+	if (!pcap_file) {
+		ret = -errno;
+		perror("Cannot open capture file");
+		goto free_slots;
+	}
+
+	pcap_path = path;
+	pcap_rx_hdr_init();
+	if (pcap_shb_write() ||
+	    pcap_idb_write(plget->pkt_type == PKT_UDP ? LINKTYPE_RAW :
+							LINKTYPE_ETHERNET,
+			   snaplen + rx_hlen) ||
+	    pcap_idb_write(LINKTYPE_ETHERNET, snaplen)) {
+		perror("Cannot write capture file");
+		ret = -EIO;
+		goto close_file;
+	}
+
+	ret = pthread_create(&pcap_thd, NULL, pcap_writer, NULL);
+	if (ret) {
+		errno = ret;
+		perror("Cannot create capture writer");
+		ret = -ret;
+		goto close_file;
+	}
+
+	return 0;
+
+close_file:
+	fclose(pcap_file);
+	pcap_file = NULL;
+free_slots:
+	free(ring.slots);
+	ring.slots = NULL;
+	return ret;
+}
+
+void pcap_close(void)
+{
+	if (!pcap_file)
+		return;
+
+	__atomic_store_n(&ring.stop, 1, __ATOMIC_RELEASE);
+	pthread_join(pcap_thd, NULL);
+
+	if (pcap_err || fclose(pcap_file))
+		perror("Cannot write capture file");
+
+	printf("capture: %lu frames written to %s, %lu dropped\n",
+	       ring.frames, pcap_path, ring.drops);
+
+	pcap_file = NULL;
+	free(ring.slots);
+}
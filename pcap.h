@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PLGET_PCAP_H
+#define PLGET_PCAP_H
+
+#include <linux/types.h>
+
+#define PCAP_SNAPLEN			1522
+
+/*
+ * Capture to pcapng file, see -C. Frames are copied to preallocated slots
+ * of ring and written by own thread, so only one thread can push them.
+ * Timestamps are in ns, not known ones are zero.
+ */
+int pcap_open(const char *path, int snaplen);
+void pcap_close(void);
+void pcap_rx(const char *pkt, int len, __u64 app, __u64 sw, __u64 hw,
+	     __u32 id);
+void pcap_tx(const char *pkt, int len, __u64 sw, __u64 hw, __u32 id);
+
+#endif
@@ -15,28 +15,49 @@
 #include <poll.h>
 #include <stdio.h>
 #include "pkt_gen.h"
+#include "uring.h"
 #include <unistd.h>
 #include <errno.h>
 
 #define MAX_LATENCY			5000
 
-static int fast_pktgen(void)
+/* send packet, via io_uring it's only queued till submit is set */
+static int pktgen_sendto(int submit)
 {
 	struct sockaddr *addr = (struct sockaddr *)&plget->sk_addr;
 	int dsize = plget->sk_payload_size;
-	int sid = plget->stream_id;
-	char *packet = plget->pkt;
-	int sfd = plget->sfd;
 	int ret;
 
+	if (plget->flags & PLF_URING) {
+		ret = uring_tx_send(plget->pkt, submit);
+		return ret ? ret : dsize;
+	}
+
+	return sendto(plget->sfd, plget->pkt, dsize, 0, addr,
+		      plget->sk_addr_len);
+}
+
+static int fast_pktgen(void)
+{
+	int dsize = plget->sk_payload_size;
+	int sid = plget->stream_id;
+	struct timespec ts;
+	int ret, submit;
+
 	plget->inum = plget->pkt_num ? plget->pkt_num : ~0;
 	for (plget->icnt = 0; plget->icnt < plget->inum; plget->icnt++) {
 		if (plget->flags & PLF_PTP)
 			sid_wr(htons((plget->icnt & SEQ_ID_MASK) | sid));
 
+		if (plget->flags & PLF_TX_TS) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			tx_ts_wr(&ts);
+		}
+
 		tid_wr(plget->icnt);
-		ret = sendto(sfd, packet, dsize, 0, addr,
-			     sizeof(plget->sk_addr));
+		submit = !((plget->icnt + 1) % plget->batch) ||
+			 plget->icnt + 1 == plget->inum;
+		ret = pktgen_sendto(submit);
 		if (ret != dsize) {
 			if (ret < 0)
 				perror("sendto");
@@ -53,12 +74,10 @@ static int fast_pktgen(void)
 
 int pktgen_proc(void)
 {
-	struct sockaddr *addr = (struct sockaddr *)&plget->sk_addr;
 	int dsize = plget->sk_payload_size;
 	int sid = plget->stream_id;
-	char *packet = plget->pkt;
-	int sfd = plget->sfd;
 	struct pollfd fds[1];
+	struct timespec ts;
 	uint64_t exps;
 	int ret;
 
@@ -70,6 +89,9 @@ int pktgen_proc(void)
 	fds[0].events = POLLIN;
 
 	plget->inum = plget->pkt_num ? plget->pkt_num : ~0;
+	if (plget->flags & PLF_PTP)
+		sid_wr(htons(sid));
+
 	tid_wr(0);
 
 	for (plget->icnt = 0; plget->icnt < plget->inum;) {
@@ -90,8 +112,14 @@ int pktgen_proc(void)
 			if (ret < 0)
 				return perror("Couldn't read timerfd"), -errno;
 
-			ret = sendto(sfd, packet, dsize, 0, addr,
-				     sizeof(plget->sk_addr));
+			/* packet is prepared in advance, except sender ts */
+			if (plget->flags & PLF_TX_TS) {
+				clock_gettime(CLOCK_REALTIME, &ts);
+				tx_ts_wr(&ts);
+				tid_wr(plget->icnt);
+			}
+
+			ret = pktgen_sendto(1);
 			if (ret != dsize) {
 				if (ret < 0)
 					perror("sendto");
@@ -101,10 +129,14 @@ int pktgen_proc(void)
 				break;
 			}
 
+			plget->icnt++;
 			if (plget->flags & PLF_PTP)
-				sid_wr(htons((++plget->icnt & SEQ_ID_MASK) |
+				sid_wr(htons((plget->icnt & SEQ_ID_MASK) |
 					      sid));
-			tid_wr(plget->icnt);
+
+			/* w/ sender ts id is written along with it */
+			if (!(plget->flags & PLF_TX_TS))
+				tid_wr(plget->icnt);
 		}
 	}
 
@@ -112,7 +144,7 @@ int pktgen_proc(void)
 	return !(plget->icnt == plget->inum);
 }
 
-int pktgen(void)
+static int pktgen_run(void)
 {
 	int ret;
 
@@ -128,3 +160,28 @@ int pktgen(void)
 	close(plget->timer_fd);
 	return ret;
 }
+
+int pktgen(void)
+{
+	int ret;
+
+	if (!(plget->flags & PLF_URING))
+		return pktgen_run();
+
+	ret = uring_tx_setup(plget->sk_payload_size,
+			     (struct sockaddr *)&plget->sk_addr,
+			     plget->sk_addr_len, plget->pkt_type == PKT_UDP);
+	if (ret)
+		return ret;
+
+	ret = pktgen_run();
+
+	/* wait for sends in flight to get their errors */
+	if (uring_tx_flush()) {
+		perror("sendto");
+		ret = 1;
+	}
+
+	uring_release();
+	return ret;
+}
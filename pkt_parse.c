@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+#include "pkt_parse.h"
+
+#define PARSE_TAG_MAX		2
+#define PARSE_TUN_MAX		2
+#define PARSE_EXT_MAX		2
+/* eth with tags 3 + ipv6 with ext 4 + gre 2, for every tunnel level */
+#define PARSE_SIG_MAX		32
+#define PARSE_FLOW_NUM		4
+
+#define VLAN_HLEN		4
+#define VXLAN_HLEN		8
+#define VXLAN_PORT		4789
+#define IP6_EXT_HLEN		8
+
+#ifndef ETH_P_TEB
+#define ETH_P_TEB		0x6558
+#endif
+
+#define GRE_HLEN		4
+#define GRE_CSUM		0x8000
+#define GRE_KEY			0x2000
+#define GRE_SEQ			0x1000
+#define GRE_VERSION		0x0007
+
+/* field that defines layout of headers, 16 bits read in host order */
+struct parse_sig {
+	__u16 off;
+	__u16 mask;
+	__u16 val;
+};
+
+/*
+ * Layout of headers is same for all frames of flow, so it's cached along
+ * with values of fields parser has branched on. Frame matching them has
+ * same layout and isn't parsed again.
+ */
+struct parse_flow {
+	struct parse_sig sig[PARSE_SIG_MAX];
+	int sig_num;
+	int min_len;		/* end of last field read */
+	struct pkt_hdrs hdrs;
+};
+
+/* per fanout worker */
+static __thread struct parse_flow flows[PARSE_FLOW_NUM];
+static __thread int flow_num;
+static __thread int flow_next;
+
+static inline __u16 parse_rd16(const char *pkt, int off)
+{
+	__u16 val;
+
+	memcpy(&val, pkt + off, sizeof(val));
+	return ntohs(val);
+}
+
+/* read field and add it to flow signature */
+static __u16 parse_sig(struct parse_flow *f, const char *pkt, int off,
+		       __u16 mask)
+{
+	struct parse_sig *s = &f->sig[f->sig_num++];
+
+	s->off = off;
+	s->mask = mask;
+	s->val = parse_rd16(pkt, off) & mask;
+	if (off + 2 > f->min_len)
+		f->min_len = off + 2;
+
+	return s->val;
+}
+
+static int parse_ipv6_ext(__u8 nh)
+{
+	return nh == IPPROTO_HOPOPTS || nh == IPPROTO_ROUTING ||
+	       nh == IPPROTO_DSTOPTS;
+}
+
+/* parse headers of new flow, fields it depends on are its signature */
+static int parse_flow(struct parse_flow *f, const char *pkt, int len)
+{
+	struct pkt_hdrs *h = &f->hdrs;
+	int off = 0, tun = 0, hlen, tags, ext;
+	__u16 val;
+
+	f->sig_num = 0;
+	f->min_len = 0;
+	h->l3_off = -1;
+	h->l4_off = -1;
+	h->dport = 0;
+
+parse_eth:
+	off += ETH_ALEN * 2;
+	for (tags = 0;; tags++) {
+		if (off + 2 > len)
+			return -1;
+
+		h->proto = parse_sig(f, pkt, off, 0xffff);
+		off += 2;
+		if (tags == PARSE_TAG_MAX || (h->proto != ETH_P_8021Q &&
+					      h->proto != ETH_P_8021AD))
+			break;
+
+		off += VLAN_HLEN - 2;
+	}
+
+parse_l3:
+	h->l4_proto = 0;
+	if (h->proto == ETH_P_IP) {
+		if (off + sizeof(struct iphdr) > len)
+			return -1;
+
+		val = parse_sig(f, pkt, off, 0xff00) >> 8;
+		hlen = (val & 0xf) * 4;
+		if (val >> 4 != 4 || hlen < sizeof(struct iphdr) ||
+		    off + hlen > len)
+			goto out;
+
+		/* only first fragment has udp header */
+		if (parse_sig(f, pkt, off + 6, 0x1fff))
+			goto out;
+
+		val = parse_sig(f, pkt, off + 8, 0x00ff);
+	} else if (h->proto == ETH_P_IPV6) {
+		if (off + sizeof(struct ip6_hdr) > len)
+			return -1;
+
+		if (parse_sig(f, pkt, off, 0xf000) >> 12 != 6)
+			goto out;
+
+		val = parse_sig(f, pkt, off + 6, 0xff00) >> 8;
+		hlen = sizeof(struct ip6_hdr);
+		for (ext = 0; parse_ipv6_ext(val); ext++) {
+			if (ext == PARSE_EXT_MAX)
+				goto out;
+
+			if (off + hlen + IP6_EXT_HLEN > len)
+				return -1;
+
+			val = parse_sig(f, pkt, off + hlen, 0xffff);
+			hlen += ((val & 0xff) + 1) * 8;
+			val >>= 8;
+		}
+
+		if (off + hlen > len)
+			return -1;
+	} else {
+		goto out;
+	}
+
+	if (h->l3_off < 0)
+		h->l3_off = off;
+
+	off += hlen;
+	if (h->l4_off < 0)
+		h->l4_off = off;
+
+	h->l4_proto = val;
+	if (val == IPPROTO_UDP) {
+		if (off + sizeof(struct udphdr) > len)
+			return -1;
+
+		h->dport = parse_sig(f, pkt, off + 2, 0xffff);
+		off += sizeof(struct udphdr);
+		if (h->dport != VXLAN_PORT || tun == PARSE_TUN_MAX)
+			goto out;
+
+		if (off + VXLAN_HLEN > len)
+			return -1;
+
+		off += VXLAN_HLEN;
+		tun++;
+		goto parse_eth;
+	}
+
+	if (val == IPPROTO_GRE && tun < PARSE_TUN_MAX) {
+		if (off + GRE_HLEN > len)
+			return -1;
+
+		val = parse_sig(f, pkt, off, 0xffff);
+		h->proto = parse_sig(f, pkt, off + 2, 0xffff);
+		if (val & GRE_VERSION)
+			goto out;
+
+		off += GRE_HLEN;
+		off += val & GRE_CSUM ? 4 : 0;
+		off += val & GRE_KEY ? 4 : 0;
+		off += val & GRE_SEQ ? 4 : 0;
+		tun++;
+		if (h->proto == ETH_P_TEB)
+			goto parse_eth;
+
+		goto parse_l3;
+	}
+
+out:
+	if (off > len)
+		return -1;
+
+	h->off = off;
+	return 0;
+}
+
+static int parse_match(struct parse_flow *f, const char *pkt, int len)
+{
+	struct parse_sig *s;
+	int i;
+
+	if (len < f->min_len || len < f->hdrs.off)
+		return 0;
+
+	for (i = 0; i < f->sig_num; i++) {
+		s = &f->sig[i];
+		if ((parse_rd16(pkt, s->off) & s->mask) != s->val)
+			return 0;
+	}
+
+	return 1;
+}
+
+int parse_pkt(const char *pkt, int len, struct pkt_hdrs *hdrs)
+{
+	struct parse_flow *f, nf;
+	int i;
+
+	for (i = 0; i < flow_num; i++) {
+		f = &flows[i];
+		if (parse_match(f, pkt, len)) {
+			*hdrs = f->hdrs;
+			return 0;
+		}
+	}
+
+	if (parse_flow(&nf, pkt, len))
+		return -1;
+
+	/* new flow replaces oldest one */
+	flows[flow_next] = nf;
+	flow_next = (flow_next + 1) % PARSE_FLOW_NUM;
+	if (flow_num < PARSE_FLOW_NUM)
+		flow_num++;
+
+	*hdrs = nf.hdrs;
+	return 0;
+}
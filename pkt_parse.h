@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PKT_PARSE_H
+#define PKT_PARSE_H
+
+#include <linux/types.h>
+
+/* headers of ethernet frame, innermost ones if it's tunneled */
+struct pkt_hdrs {
+	int off;		/* payload, after udp or ethernet header */
+	int l3_off;		/* outer ip header, -1 if none */
+	int l4_off;		/* outer l4 header, -1 if none */
+	__u16 proto;		/* ethertype behind vlan tags */
+	__u16 dport;		/* udp destination port, host order */
+	__u8 l4_proto;		/* ip protocol, 0 if not ip */
+};
+
+/*
+ * Parse ethernet frame, vlan tags, ipv4/ipv6, udp and vxlan or gre tunnels.
+ * Returns 0 if headers are complete, layouts are cached per flow.
+ */
+int parse_pkt(const char *pkt, int len, struct pkt_hdrs *hdrs);
+
+#endif
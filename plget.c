@@ -25,6 +25,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <netinet/ip6.h>
+#include <ifaddrs.h>
+#include <stddef.h>
+#include <sys/epoll.h>
 #include "plget_args.h"
 #include "plget.h"
 #include "rx_lat.h"
@@ -36,6 +42,12 @@
 #include "result.h"
 #include "xdp_sock.h"
 #include "xdp_prog_load.h"
+#include "rx_ring.h"
+#include "fanout.h"
+#include "uring.h"
+#include "pcap.h"
+#include "coal.h"
+#include "vec.h"
 #include <pthread.h>
 #include "rtprint.h"
 #include <linux/ethtool.h>
@@ -49,17 +61,19 @@
 	((void *)ALIGN_ROUNDUP((uintptr_t)(x), (uintptr_t)(align)))
 
 #define OFF_PTP_SEQUENCE_ID		30
-#define UDP_HLEN	42
+#define UDP_HLEN			(ETH_HLEN + ip_udp_hlen())
 
-struct plgett *plget;
+__thread struct plgett *plget;
 
 struct stats tx_app_v;
 struct stats *tx_sch_v;
 struct stats tx_sw_v;
 struct stats tx_hw_v;
-struct stats rx_app_v;
-struct stats rx_sw_v;
-struct stats rx_hw_v;
+__thread struct stats rx_app_v;
+__thread struct stats rx_sw_v;
+__thread struct stats rx_hw_v;
+__thread struct stats rx_snd_v;	/* sender ts, see -o tx_ts */
+__thread struct stats_hist rx_lat_h[RX_STAGE_NUM];
 
 struct stats temp;
 
@@ -314,7 +328,12 @@ static int enable_hw_timestamping(void)
 		if (!(plget->flags & PLF_PTP)) {
 			hwconfig.rx_filter = HWTSTAMP_FILTER_ALL;
 		} else {
-			if (plget->pkt_type == PKT_UDP)
+			/* not every NIC sees sync msg behind vlan tag */
+			if (plget->vlan_num)
+				hwconfig.rx_filter =
+					HWTSTAMP_FILTER_PTP_V2_EVENT;
+			else if (plget->pkt_type == PKT_UDP ||
+				 plget->flags & PLF_RAW_UDP)
 				hwconfig.rx_filter =
 					HWTSTAMP_FILTER_PTP_V2_L4_SYNC;
 			else
@@ -340,6 +359,94 @@ static int enable_hw_timestamping(void)
 	return ret;
 }
 
+static int udp6_mcast(int sfd)
+{
+	char str[INET6_ADDRSTRLEN];
+	int ip_multicast_loop = 0;
+	struct ipv6_mreq mreq;
+	int ret;
+
+	/* set multicast interface for outgoing packets */
+	ret = setsockopt(sfd, IPPROTO_IPV6, IPV6_MULTICAST_IF, &plget->ifidx,
+			 sizeof(plget->ifidx));
+	if (ret < 0)
+		return perror("set multicast"), -errno;
+
+	if (plget->mod == TX_LAT || plget->mod == PKT_GEN)
+		return sfd;
+
+	/* join multicast group */
+	mreq.ipv6mr_multiaddr = plget->iaddr6;
+	mreq.ipv6mr_interface = plget->ifidx;
+	ret = setsockopt(sfd, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq,
+			 sizeof(mreq));
+	if (ret < 0)
+		return perror("join multicast group"), -errno;
+
+	printf("joined mcast group: %s\n",
+	       inet_ntop(AF_INET6, &plget->iaddr6, str, sizeof(str)));
+
+	ret = setsockopt(sfd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP,
+			 &ip_multicast_loop, sizeof(ip_multicast_loop));
+	if (ret < 0)
+		perror("loop multicast");
+
+	return sfd;
+}
+
+/* udp fanout workers share the port, has to be set before bind */
+static int udp_reuseport(int sfd)
+{
+	int val = 1;
+	int ret;
+
+	if (!(plget->flags & PLF_FANOUT))
+		return 0;
+
+	ret = setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val));
+	if (ret < 0)
+		return perror("Couldn't set SO_REUSEPORT"), -errno;
+
+	return 0;
+}
+
+static int udp6_socket(void)
+{
+	struct sockaddr_in6 *addr = &plget->sk_addr6;
+	int sfd, ret;
+
+	sfd = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	if (sfd < 0)
+		return perror("socket"), -errno;
+
+	addr->sin6_family = AF_INET6;
+	addr->sin6_port = htons(plget->port);
+	plget->sk_addr_len = sizeof(struct sockaddr_in6);
+
+	if (udp_reuseport(sfd))
+		return -errno;
+
+	/* bind to the interface before bind() to not break reuseport group */
+	ret = setsockopt(sfd, SOL_SOCKET, SO_BINDTODEVICE, plget->if_name,
+			 sizeof(plget->if_name));
+	if (ret < 0)
+		return perror("Couldn't bind to the interface"), -errno;
+
+	ret = bind(sfd, (struct sockaddr *)addr, sizeof(struct sockaddr_in6));
+	if (ret < 0)
+		return perror("Couldn't bind"), -errno;
+
+	addr->sin6_addr = plget->iaddr6;
+	if (IN6_IS_ADDR_LINKLOCAL(&plget->iaddr6) ||
+	    IN6_IS_ADDR_MC_LINKLOCAL(&plget->iaddr6))
+		addr->sin6_scope_id = plget->ifidx;
+
+	if (!(plget->flags & PLF_PTP))
+		return sfd;
+
+	return udp6_mcast(sfd);
+}
+
 static int udp_socket(void)
 {
 	struct sockaddr_in *addr = (struct sockaddr_in *)&plget->sk_addr;
@@ -347,25 +454,32 @@ static int udp_socket(void)
 	struct ip_mreqn mreq;
 	int sfd, ret;
 
+	if (plget->flags & PLF_IPV6)
+		return udp6_socket();
+
 	sfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
 	if (sfd < 0)
 		return perror("socket"), -errno;
 
 	addr->sin_family = AF_INET;
 	addr->sin_port = htons(plget->port);
+	plget->sk_addr_len = sizeof(struct sockaddr_in);
 
-	ret = bind(sfd, (struct sockaddr *)addr, sizeof(struct sockaddr_in));
-	if (ret < 0)
-		return perror("Couldn't bind"), -errno;
-
-	addr->sin_addr = plget->iaddr;
+	if (udp_reuseport(sfd))
+		return -errno;
 
-	/* bind socket to the interface */
+	/* bind to the interface before bind() to not break reuseport group */
 	ret = setsockopt(sfd, SOL_SOCKET, SO_BINDTODEVICE, plget->if_name,
 			 sizeof(plget->if_name));
 	if (ret < 0)
 		return perror("Couldn't bind to the interface"), -errno;
 
+	ret = bind(sfd, (struct sockaddr *)addr, sizeof(struct sockaddr_in));
+	if (ret < 0)
+		return perror("Couldn't bind"), -errno;
+
+	addr->sin_addr = plget->iaddr;
+
 	if (!(plget->flags & PLF_PTP))
 		return sfd;
 
@@ -401,6 +515,9 @@ static void specify_protocol(__u16 *protocol)
 {
 	if (plget->flags & PLF_AVTP)
 		*protocol = htons(ETH_P_TSN);
+	else if (plget->flags & PLF_RAW_UDP)
+		*protocol = htons(plget->flags & PLF_IPV6 ? ETH_P_IPV6 :
+							    ETH_P_IP);
 	else if (plget->flags & PLF_PTP)
 		*protocol = htons(ETH_P_1588);
 	else
@@ -464,6 +581,7 @@ static int packet_socket(void)
 
 	addr->sll_family = AF_PACKET;
 	addr->sll_protocol = protocol;
+	plget->sk_addr_len = sizeof(struct sockaddr_ll);
 
 	/* If user provided a network interface, bind() to it. */
 	if (plget->if_name[0] != '\0')
@@ -483,6 +601,64 @@ static int packet_socket(void)
 }
 
 
+#ifndef EPIOCSPARAMS
+struct epoll_params {
+	__u32 busy_poll_usecs;
+	__u16 busy_poll_budget;
+	__u8 prefer_busy_poll;
+	__u8 __pad;
+};
+
+#define EPIOCSPARAMS			_IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
+/*
+ * With prefer busy poll app drives NAPI of the rx queue from epoll_wait(),
+ * irqs are deferred while it keeps polling.
+ */
+static int plget_epoll_init(void)
+{
+	struct epoll_params params;
+	struct epoll_event ev;
+	int sfd = plget->sfd;
+	int val = 1, ret;
+
+	plget->epfd = epoll_create1(0);
+	if (plget->epfd < 0)
+		return perror("Couldn't create epoll"), -errno;
+
+	ev.events = EPOLLIN;
+	ev.data.fd = sfd;
+	ret = epoll_ctl(plget->epfd, EPOLL_CTL_ADD, sfd, &ev);
+	if (ret < 0)
+		return perror("Couldn't add socket to epoll"), -errno;
+
+	if (!plget->busypoll_budget)
+		return 0;
+
+	ret = setsockopt(sfd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &val,
+			 sizeof(val));
+	if (ret < 0)
+		return perror("Couldn't set prefer busy poll"), -errno;
+
+	ret = setsockopt(sfd, SOL_SOCKET, SO_BUSY_POLL_BUDGET,
+			 &plget->busypoll_budget,
+			 sizeof(plget->busypoll_budget));
+	if (ret < 0)
+		return perror("Couldn't set busy poll budget"), -errno;
+
+	/* older kernels busy poll epoll only if net.core.busy_poll is set */
+	memset(&params, 0, sizeof(params));
+	params.busy_poll_usecs = plget->busypoll_time;
+	params.busy_poll_budget = plget->busypoll_budget;
+	params.prefer_busy_poll = 1;
+	if (ioctl(plget->epfd, EPIOCSPARAMS, &params))
+		printf("EPIOCSPARAMS is not supported, net.core.busy_poll "
+		       "is used for epoll busy poll time\n");
+
+	return 0;
+}
+
 static int plget_more_sock_options(void)
 {
 	int sfd = plget->sfd;
@@ -503,6 +679,30 @@ static int plget_more_sock_options(void)
 			return perror("Couldn't set busy poll time"), -errno;
 	}
 
+	if (plget->flags & PLF_EPOLL)
+		return plget_epoll_init();
+
+	return 0;
+}
+
+/* rx is armed right away, tx buffers are registered once packet is built */
+static int plget_uring_setup(void)
+{
+	int ret;
+
+	ret = uring_setup(plget->sfd, plget->flags & PLF_SQPOLL);
+	if (ret)
+		return ret;
+
+	if (plget->flags & PLF_BUSYPOLL) {
+		ret = uring_napi_setup(plget->busypoll_time);
+		if (ret)
+			return ret;
+	}
+
+	if (plget->mod == RX_LAT || plget->mod == RX_RATE)
+		return uring_rx_setup(CONTROL_LEN);
+
 	return 0;
 }
 
@@ -524,6 +724,13 @@ static int plget_create_socket(void)
 	if (plget_more_sock_options())
 		return -errno;
 
+	if (plget->flags & PLF_RX_RING)
+		return rx_ring_setup(plget->sfd,
+				     !(plget->flags & PLF_DIS_HW_TS));
+
+	if (plget->flags & PLF_URING)
+		return plget_uring_setup();
+
 	return 0;
 }
 
@@ -531,6 +738,9 @@ static void init_pkt_ether_header(void)
 {
 	struct ether_header *eth = (struct ether_header *)plget->pkt;
 	struct ether_addr *dst_addr, *src_addr;
+	__u16 proto, tci;
+	char *p;
+	int i;
 
 	dst_addr = (struct ether_addr *)eth->ether_dhost;
 	src_addr = (struct ether_addr *)eth->ether_shost;
@@ -538,54 +748,177 @@ static void init_pkt_ether_header(void)
 	*dst_addr = plget->macaddr;
 	*src_addr = plget->if_addr;
 
-	specify_protocol(&eth->ether_type);
+	/* outer tag is service one for QinQ */
+	p = plget->pkt + ETH_ALEN * 2;
+	for (i = 0; i < plget->vlan_num; i++) {
+		proto = i == plget->vlan_num - 1 ? htons(ETH_P_8021Q) :
+						   htons(ETH_P_8021AD);
+		tci = htons(plget->vlan_tci[i]);
+
+		memcpy(p, &proto, sizeof(proto));
+		memcpy(p + sizeof(proto), &tci, sizeof(tci));
+		p += VLAN_HLEN;
+	}
+
+	specify_protocol(&proto);
+	memcpy(p, &proto, sizeof(proto));
+}
+
+static struct udphdr *init_pkt_ip6_header(void)
+{
+	struct ip6_hdr *ip6h;
+	int ip_len;
+
+	ip6h = (struct ip6_hdr *)(plget->pkt + eth_hlen());
+	ip_len = plget->sk_payload_size - eth_hlen();
+
+	memset(ip6h, 0, sizeof(*ip6h));
+	ip6h->ip6_flow = htonl(6 << 28);
+	ip6h->ip6_plen = htons(ip_len - sizeof(*ip6h));
+	ip6h->ip6_nxt = IPPROTO_UDP;
+	ip6h->ip6_hlim = plget_iaddr_mcast() ? 1 : 64;
+	ip6h->ip6_src = plget->if_iaddr6;
+	ip6h->ip6_dst = plget->iaddr6;
+
+	return (struct udphdr *)(ip6h + 1);
+}
+
+static struct udphdr *init_pkt_ip_header(void)
+{
+	struct iphdr *iph;
+	int ip_len;
+
+	if (plget->flags & PLF_IPV6)
+		return init_pkt_ip6_header();
+
+	iph = (struct iphdr *)(plget->pkt + eth_hlen());
+	ip_len = plget->sk_payload_size - eth_hlen();
+
+	memset(iph, 0, sizeof(*iph));
+	iph->version = 4;
+	iph->ihl = sizeof(*iph) >> 2;
+	iph->tot_len = htons(ip_len);
+	iph->frag_off = htons(IP_DF);
+	iph->ttl = plget_iaddr_mcast() ? 1 : 64;
+	iph->protocol = IPPROTO_UDP;
+	iph->saddr = plget->if_iaddr.s_addr;
+	iph->daddr = plget->iaddr.s_addr;
+	iph->check = htons(csum_fold(csum_add(0, iph, sizeof(*iph), 0)));
+
+	return (struct udphdr *)(iph + 1);
+}
+
+static void init_pkt_udp_header(void)
+{
+	struct udphdr *udph;
+
+	udph = init_pkt_ip_header();
+	udph->source = htons(plget->port);
+	udph->dest = htons(plget->port);
+	udph->len = htons(plget->sk_payload_size - eth_hlen() -
+			  ip_udp_hlen() + UDPH_LEN);
+	udph->check = 0;
+}
+
+/* partial udp csum of template frame including pseudo header */
+static __u32 udp_csum_base(void)
+{
+	struct udphdr *udph;
+	struct ip6_hdr *ip6h;
+	struct iphdr *iph;
+	__u32 sum;
+
+	if (plget->flags & PLF_IPV6) {
+		ip6h = (struct ip6_hdr *)(plget->pkt + eth_hlen());
+		udph = (struct udphdr *)(ip6h + 1);
+
+		sum = csum_add(0, &ip6h->ip6_src, sizeof(ip6h->ip6_src), 0);
+		sum = csum_add(sum, &ip6h->ip6_dst, sizeof(ip6h->ip6_dst), 0);
+	} else {
+		iph = (struct iphdr *)(plget->pkt + eth_hlen());
+		udph = (struct udphdr *)(iph + 1);
+
+		sum = csum_add(0, &iph->saddr, sizeof(iph->saddr), 0);
+		sum = csum_add(sum, &iph->daddr, sizeof(iph->daddr), 0);
+	}
+
+	sum += IPPROTO_UDP + ntohs(udph->len);
+
+	return csum_add(sum, udph, ntohs(udph->len), 0);
 }
 
 static void fill_in_packets(void)
 {
 	int ptp_payload_size;
 	int n, i, j;
+	__u32 seed;
 	char *dp;
 
-	ptp_payload_size = plget->sk_payload_size;
-	if (plget->pkt_type == PKT_XDP || plget->pkt_type == PKT_RAW)
-		ptp_payload_size -= ETH_HLEN;
-
+	ptp_payload_size = plget->sk_payload_size - plget->hdr_size;
 	if (plget->flags & PLF_PTP)
 		ptp_payload_size -= PTP_HSIZE;
 
-	n = (plget->pkt_type == PKT_XDP) ? FRAME_NUM : 1;
-	for (i = 0; i < n; i++) {
-		if (plget->pkt_type == PKT_XDP) {
-			j = FRAME_SIZE * i;
-			plget->pkt = &plget->xsk->umem->frames[j];
-		}
+	if (plget->pkt_type == PKT_RAW || plget->pkt_type == PKT_XDP) {
+		init_pkt_ether_header();
+		if (plget->flags & PLF_RAW_UDP)
+			init_pkt_udp_header();
 
-		if (plget->pkt_type == PKT_RAW || plget->pkt_type == PKT_XDP) {
-			init_pkt_ether_header();
-			dp = plget->pkt + ETH_HLEN;
-		} else {
-			dp = plget->pkt;
-		}
+		dp = plget->pkt + plget->hdr_size;
+	} else {
+		dp = plget->pkt;
+	}
 
-		if (plget->flags & PLF_PTP) {
-			memcpy(dp, ptpv2_sync_pkt, PTP_HSIZE);
-			dp += PTP_HSIZE;
-		}
+	if (plget->flags & PLF_PTP) {
+		memcpy(dp, ptpv2_sync_pkt, PTP_HSIZE);
+		dp += PTP_HSIZE;
+	}
 
-		*dp++ = MAGIC;
+	*dp++ = MAGIC;
 
-		for (j = 0; j < ptp_payload_size; j++)
-			*dp++ = (rand() % 230) + 1;
+	/* magic is part of payload, same seed gives same payload */
+	seed = plget->seed;
+	for (j = 1; j < ptp_payload_size; j++) {
+		seed = seed * 1664525 + 1013904223;
+		*dp++ = ((seed >> 24) % 230) + 1;
 	}
 
-	if (plget->pkt_type == PKT_XDP)
-		plget->pkt = plget->xsk->umem->frames;
+	/* crc is written with every tid */
+	if (plget->flags & PLF_CRC) {
+		plget->off_crc = plget->sk_payload_size - CRC_LEN;
+		memset(plget->pkt + plget->off_crc, 0, CRC_LEN);
+	}
+
+	/* w/o PTP header stream id follows ts id, it's same for all packets */
+	if (!(plget->flags & PLF_PTP))
+		plget->pkt[plget->off_tid_wr + sizeof(__u32)] =
+			plget->stream_id >> STREAM_ID_SHIFT;
+
+	/* ids, sender ts and crc are filled per packet, csum base w/o them */
+	if (plget->flags & PLF_RAW_UDP) {
+		memset(plget->pkt + plget->off_tid_wr, 0, sizeof(__u32));
+		if (plget->flags & PLF_PTP)
+			memset(plget->pkt + plget->off_sid_wr, 0,
+			       sizeof(__u16));
+
+		if (plget->flags & PLF_TX_TS)
+			memset(plget->pkt + plget->off_ts_wr, 0,
+			       sizeof(__u64));
+
+		plget->csum_base = udp_csum_base();
+		plget->off_csum = eth_hlen() + ip_udp_hlen() - UDPH_LEN +
+				  offsetof(struct udphdr, check);
+	}
+
+	/* all af_xdp frames are copies of first one */
+	n = (plget->pkt_type == PKT_XDP) ? FRAME_NUM : 1;
+	for (i = 1; i < n; i++)
+		memcpy(&plget->xsk->umem->frames[FRAME_SIZE * i], plget->pkt,
+		       plget->sk_payload_size);
 }
 
 static int plget_create_packet(void)
 {
-	int payload_size;
+	int payload_size, hlen_delta, pl_size, pl_min;
 
 	/* check settings */
 	if (plget->frame_size &&
@@ -595,18 +928,24 @@ static int plget_create_packet(void)
 	}
 
 	/* adjust size and payload for packet */
-	if (plget->pkt_type == PKT_UDP) {
+	if (plget->pkt_type == PKT_UDP || plget->flags & PLF_RAW_UDP) {
+		/* ipv6 header is longer */
+		hlen_delta = ip_udp_hlen() - (IPV4_HLEN + UDPH_LEN);
+
 		if (plget->flags & PLF_PTP) {
 			if (plget->frame_size &&
-			    plget->frame_size < 100) {
-				printf("packet size should be > 99\n");
+			    plget->frame_size < 100 + hlen_delta) {
+				printf("packet size should be > %d\n",
+				       99 + hlen_delta);
 				return -EINVAL;
 			} else if (!plget->frame_size)
-				plget->frame_size = 100;
+				plget->frame_size = 100 + hlen_delta;
 		} else if (!plget->frame_size)
-			plget->frame_size = 66;
+			plget->frame_size = 66 + hlen_delta;
 
-		payload_size = plget->frame_size - UDP_HLEN;
+		payload_size = plget->frame_size;
+		if (plget->pkt_type == PKT_UDP)
+			payload_size -= UDP_HLEN;
 	} else {
 		if (plget->flags & PLF_PTP) {
 			if (plget->frame_size &&
@@ -623,12 +962,31 @@ static int plget_create_packet(void)
 			payload_size -= ETH_HLEN;
 	}
 
+	/* magic, ids, sender ts and crc have to fit in payload */
+	pl_size = payload_size - plget->hdr_size;
+	if (plget->flags & PLF_PTP)
+		pl_size -= PTP_HSIZE;
+
+	pl_min = PL_TX_TS_OFF;
+	if (plget->flags & PLF_TX_TS)
+		pl_min += sizeof(__u64);
+	if (plget->flags & PLF_CRC)
+		pl_min += CRC_LEN;
+
+	if (pl_size < pl_min) {
+		printf("packet size should be > %d\n",
+		       plget->frame_size + pl_min - pl_size - 1);
+		return -EINVAL;
+	}
+
 	/* allocate packet */
 	plget->sk_payload_size = payload_size;
 	if (plget->pkt_type != PKT_XDP) {
 		plget->pkt = malloc(payload_size);
 		if (!plget->pkt)
 			return -ENOMEM;
+	} else {
+		plget->pkt = plget->xsk->umem->frames;
 	}
 
 	fill_in_packets();
@@ -645,11 +1003,12 @@ static void fill_in_data_pointers(void)
 	plget->msg.msg_iovlen = 1;
 	plget->msg.msg_control = plget->control;
 	plget->msg.msg_controllen = sizeof(plget->control);
+	if (plget->flags & PLF_RX_CPU)
+		plget->msg.msg_name = &plget->rx_peer;
 
 	plget->rx_pkt = plget->data;
 
-	if (plget->pkt_type == PKT_XDP || plget->pkt_type == PKT_RAW)
-		off += ETH_HLEN;
+	off += plget->hdr_size;
 
 	if (plget->flags & PLF_PTP)
 		plget->off_sid_wr = off + OFF_PTP_SEQUENCE_ID;
@@ -657,23 +1016,75 @@ static void fill_in_data_pointers(void)
 	if (plget->flags & PLF_PTP)
 		off += PTP_HSIZE;
 
-	if (plget->mod != ECHO_LAT)
+	if (plget->mod != ECHO_LAT) {
 		plget->off_tid_wr = off + 1;
+		plget->off_ts_wr = off + PL_TX_TS_OFF;
+	}
 
-	plget->off_magic_rd = off;
-	plget->off_tid_rd = off + 1;
+	plget->off_magic_pl = 0;
+	plget->off_sid_rd = 1 + sizeof(__u32);
+	if (plget->flags & PLF_PTP) {
+		plget->off_magic_pl = PTP_HSIZE;
+		plget->off_sid_rd = OFF_PTP_SEQUENCE_ID - (int)PTP_HSIZE;
+	}
 
-	plget->off_magic_rx_rd = off;
-	plget->off_tid_rx_rd = off + 1;
+	/* socket w/o link layer gets payload, raw frames are parsed */
+	plget->rx_off = plget->off_magic_pl;
+}
 
-	/* add sent_payload - sk_payload */
-	if (plget->pkt_type == PKT_ETH) {
-		plget->off_magic_rd += ETH_HLEN;
-		plget->off_tid_rd += ETH_HLEN;
-	} else if (plget->pkt_type == PKT_UDP) {
-		plget->off_magic_rd += UDP_HLEN;
-		plget->off_tid_rd += UDP_HLEN;
+/* prefer global address, link local is used only if no other */
+static void get_inf_iaddr6(void)
+{
+	struct ifaddrs *ifaddr, *ifa;
+	struct sockaddr_in6 *sa;
+	int found = 0;
+
+	if (getifaddrs(&ifaddr))
+		plget_fail("cann't get interface ipv6 address");
+
+	for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+		if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET6 ||
+		    strcmp(ifa->ifa_name, plget->if_name))
+			continue;
+
+		sa = (struct sockaddr_in6 *)ifa->ifa_addr;
+		if (found && IN6_IS_ADDR_LINKLOCAL(&sa->sin6_addr))
+			continue;
+
+		plget->if_iaddr6 = sa->sin6_addr;
+		found = 1;
+		if (!IN6_IS_ADDR_LINKLOCAL(&sa->sin6_addr))
+			break;
 	}
+
+	freeifaddrs(ifaddr);
+
+	if (!found)
+		plget_fail("interface has no ipv6 address");
+}
+
+static void get_inf_iaddr(void)
+{
+	struct ifreq ifr;
+	int sfd;
+
+	if (plget->flags & PLF_IPV6)
+		return get_inf_iaddr6();
+
+	/* not every socket family handles SIOCGIFADDR, use inet one */
+	sfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sfd < 0)
+		plget_fail("cann't create socket to get interface ip address");
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, plget->if_name, sizeof(ifr.ifr_name));
+	ifr.ifr_addr.sa_family = AF_INET;
+
+	if (ioctl(sfd, SIOCGIFADDR, &ifr))
+		plget_fail("cann't get interface ip address");
+
+	plget->if_iaddr = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr;
+	close(sfd);
 }
 
 void get_inf_addr(void)
@@ -693,6 +1104,55 @@ void get_inf_addr(void)
 		plget_fail("cann't get interface hw address");
 
 	plget->if_addr = *((struct ether_addr *)ifr.ifr_hwaddr.sa_data);
+
+	if (plget->flags & PLF_RAW_UDP)
+		get_inf_iaddr();
+}
+
+/* headers built by plget itself, are present only in raw frames */
+static void init_hdr_size(void)
+{
+	int type = plget->pkt_type;
+
+	plget->hdr_size = 0;
+	if (type != PKT_RAW && type != PKT_XDP)
+		return;
+
+	plget->hdr_size = eth_hlen();
+	if (plget->flags & PLF_RAW_UDP)
+		plget->hdr_size += ip_udp_hlen();
+}
+
+/* every stream gets own vectors and id space of -n packets */
+static int plget_reserve_streams(void)
+{
+	struct rx_stream *s;
+	int i, num = plget->pkt_num;
+
+	plget->rx_streams = calloc(STREAM_NUM, sizeof(*s));
+	if (!plget->rx_streams)
+		return -ENOMEM;
+
+	for (i = 0; i < STREAM_NUM; i++) {
+		s = &plget->rx_streams[i];
+		s->seq.seen = calloc(num, 1);
+		if (!s->seq.seen)
+			return -ENOMEM;
+
+		if (!(plget->flags & PLF_PRINTOUT))
+			continue;
+
+		if (stats_reserve(&s->app_v, num) ||
+		    stats_reserve(&s->sw_v, num) ||
+		    stats_reserve(&s->hw_v, num))
+			return -ENOMEM;
+
+		if (plget->flags & PLF_TX_TS &&
+		    stats_reserve(&s->snd_v, num))
+			return -ENOMEM;
+	}
+
+	return 0;
 }
 
 static int init_test(void)
@@ -709,10 +1169,48 @@ static int init_test(void)
 	enable_hw_timestamping();
 	res_title_print();
 
+	if (plget->flags & PLF_CRC)
+		printf("payload crc32c: %s\n", crc32c_init());
+
+	if (plget->flags & PLF_PRINTOUT)
+		printf("stats kernels: %s\n", vec_init());
+
 	if (mod == RTT_MOD || mod == ECHO_LAT || mod == TX_LAT ||
-	    mod == RX_LAT)
+	    (mod == RX_LAT && !(plget->flags & PLF_HIST)))
 		stats_reserve(&temp, plget->pkt_num);
 
+	if (plget->flags & PLF_HIST) {
+		ret = rxlat_hist_init();
+		if (ret)
+			return perror("Cannot allocate histograms"), ret;
+	}
+
+	if (mod == RX_LAT && plget->flags & PLF_STREAMS) {
+		ret = plget_reserve_streams();
+		if (ret)
+			return ret;
+	} else if (mod == RX_LAT) {
+		plget->rx_seq.seen = calloc(plget->pkt_num, 1);
+		if (!plget->rx_seq.seen)
+			return -ENOMEM;
+	}
+
+	if (plget->flags & PLF_RX_CPU) {
+		plget->rx_cpus = calloc(plget->pkt_num, sizeof(__u32));
+		plget->rx_napis = calloc(plget->pkt_num, sizeof(__u32));
+		if (!plget->rx_cpus || !plget->rx_napis)
+			return -ENOMEM;
+	}
+
+	if (plget->flags & PLF_ADAPTIVE) {
+		plget->rx_groups = calloc(plget->pkt_num, 1);
+		if (!plget->rx_groups)
+			return -ENOMEM;
+
+		plget->spin_budget = plget->spin_time ? plget->spin_time :
+							SPIN_MIN_NS;
+	}
+
 	/* reserve stats memory and set ts flags */
 	if (mod == RTT_MOD || mod == ECHO_LAT || mod == TX_LAT) {
 		if (plget->flags & PLF_PRINTOUT) {
@@ -734,10 +1232,13 @@ static int init_test(void)
 
 	if (mod == RTT_MOD || mod == ECHO_LAT || mod == RX_LAT ||
 	    mod == RX_RATE) {
-		if (plget->flags & PLF_PRINTOUT) {
+		if (plget->flags & PLF_PRINTOUT && !plget->rx_streams &&
+		    !(plget->flags & PLF_HIST)) {
 			stats_reserve(&rx_app_v, plget->pkt_num);
 			stats_reserve(&rx_sw_v, plget->pkt_num);
 			stats_reserve(&rx_hw_v, plget->pkt_num);
+			if (plget->flags & PLF_TX_TS)
+				stats_reserve(&rx_snd_v, plget->pkt_num);
 		}
 
 		ts_flags |= SOF_TIMESTAMPING_RX_SOFTWARE;
@@ -745,6 +1246,10 @@ static int init_test(void)
 
 	ts_flags |= SOF_TIMESTAMPING_RAW_HARDWARE;
 
+	/* for simplicity and speed */
+	init_hdr_size();
+	fill_in_data_pointers();
+
 	/* create and fill in packet */
 	if (mod == RTT_MOD || mod == TX_LAT || mod == PKT_GEN) {
 		ret = plget_create_packet();
@@ -752,13 +1257,33 @@ static int init_test(void)
 			return ret;
 	}
 
-	/* for simplicity and speed */
-	fill_in_data_pointers();
-
 	ret = setup_sock_ts(plget->sfd, ts_flags);
+	if (ret)
+		return ret;
+
+	if (plget->flags & PLF_CAPTURE)
+		ret = pcap_open(plget->capture, plget->snaplen);
+
 	return ret;
 }
 
+/* fanout worker gets own socket and rx buffers, plget is worker's copy */
+int plget_init_worker(void)
+{
+	int ts_flags = SOF_TIMESTAMPING_SOFTWARE |
+		       SOF_TIMESTAMPING_RX_SOFTWARE |
+		       SOF_TIMESTAMPING_RAW_HARDWARE;
+	int ret;
+
+	fill_in_data_pointers();
+
+	ret = plget_create_socket();
+	if (ret)
+		return ret;
+
+	return setup_sock_ts(plget->sfd, ts_flags);
+}
+
 int main(int argc, char **argv)
 {
 	int ret;
@@ -784,11 +1309,16 @@ int main(int argc, char **argv)
 		perror("mlockall failed");
 
 	if (plget->flags & PLF_RT_PRINT)
-		ret = pthread_create(&rt_thd, NULL, rtprint, NULL);
+		ret = pthread_create(&rt_thd, NULL, rtprint, plget);
 
 	switch (plget->mod) {
 	case RX_LAT:
-		ret = rxlat();
+		if (plget->flags & PLF_FANOUT)
+			ret = fanout();
+		else if (plget->coal_num)
+			ret = coal_sweep();
+		else
+			ret = rxlat();
 		break;
 	case TX_LAT:
 		ret = txlat();
@@ -803,7 +1333,7 @@ int main(int argc, char **argv)
 		ret = pktgen();
 		break;
 	case RX_RATE:
-		ret = rxrate();
+		ret = plget->flags & PLF_FANOUT ? fanout() : rxrate();
 		break;
 	default:
 		plget_fail("provide mode with -m");
@@ -812,6 +1342,13 @@ int main(int argc, char **argv)
 
 	xdp_unload_prog();
 
+	/* fanout closes one of main thread once workers have own ones */
+	if (plget->flags & PLF_EPOLL && !(plget->flags & PLF_FANOUT))
+		close(plget->epfd);
+
+	if (plget->flags & PLF_CAPTURE)
+		pcap_close();
+
 	if (plget->flags & PLF_RT_PRINT) {
 		plget->icnt = plget->inum;
 		pthread_join(rt_thd, NULL);
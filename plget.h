@@ -16,12 +16,15 @@
 #define PLGET_H
 
 #include <netpacket/packet.h>
+#include <endian.h>
 #include <net/ethernet.h>
 #include <netinet/in.h>
 #include <net/if.h>
 #include <string.h>
 #include <sys/time.h>
 #include "stat.h"
+#include "csum.h"
+#include "crc32c.h"
 
 #ifndef XDP_RX_RING
 #include "linux/if_xdp.h"
@@ -33,20 +36,43 @@
 #define MAGIC				0x34
 #define SEQ_ID_MASK			0x3fff
 #define STREAM_ID_SHIFT			14
+#define STREAM_NUM			4
+#define COAL_SWEEP_MAX			16
+#define IPV4_HLEN			20
+#define IPV6_HLEN			40
+#define UDPH_LEN			8
+#define VLAN_HLEN			4
+#define VLAN_MAX_NUM			2
+#define PL_HLEN				5	/* magic + ts id */
+#define PL_TX_TS_OFF			6	/* sender ts, behind stream id */
 
 extern struct stats tx_app_v;
 extern struct stats *tx_sch_v;
 extern struct stats tx_sw_v;
 extern struct stats tx_hw_v;
-extern struct stats rx_app_v;
-extern struct stats rx_sw_v;
-extern struct stats rx_hw_v;
+/* rx vectors and plget are per fanout worker */
+extern __thread struct stats rx_app_v;
+extern __thread struct stats rx_sw_v;
+extern __thread struct stats rx_hw_v;
+extern __thread struct stats rx_snd_v;
+
+/* rx latencies counted as packets come, instead of rx vectors, -o hist */
+enum rx_stage {
+	RX_STAGE_DRV,		/* wire -> net subsystem */
+	RX_STAGE_STACK,		/* net subsystem -> app */
+	RX_STAGE_ALL,		/* wire -> app */
+	RX_STAGE_OW,		/* sender app -> wire, see -o tx_ts */
+	RX_STAGE_E2E,		/* sender app -> app */
+	RX_STAGE_NUM
+};
+
+extern __thread struct stats_hist rx_lat_h[RX_STAGE_NUM];
 
 extern struct stats temp;
 
-extern struct plgett *plget;
+extern __thread struct plgett *plget;
 
-#define BIT(X)				(1 << (X))
+#define BIT(X)				(1ULL << (X))
 #define PLF_TITLE			BIT(0)
 #define PLF_PTP				BIT(1)
 #define PLF_AVTP			BIT(2)
@@ -65,6 +91,22 @@ extern struct plgett *plget;
 #define PLF_RT_PRINT			BIT(15)
 #define PLF_SW_POLL			BIT(16)
 #define PLF_RTIME			BIT(17)
+#define PLF_RAW_UDP			BIT(18)
+#define PLF_IPV6			BIT(19)
+#define PLF_RX_RING			BIT(20)
+#define PLF_FANOUT			BIT(21)
+#define PLF_EPOLL			BIT(22)
+#define PLF_ADAPTIVE			BIT(23)
+#define PLF_URING			BIT(24)
+#define PLF_SQPOLL			BIT(25)
+#define PLF_STREAMS			BIT(26)
+#define PLF_RX_CPU			BIT(27)
+#define PLF_CRC				BIT(28)
+#define PLF_CAPTURE			BIT(29)
+#define PLF_CAPTURE_TX			BIT(30)
+#define PLF_TX_TS			BIT(31)
+#define PLF_COAL			BIT(32)
+#define PLF_HIST			BIT(33)
 
 #define PLF_PRINTOUT			(PLF_HW_STAT |\
 					PLF_IPGAP_STAT |\
@@ -73,6 +115,16 @@ extern struct plgett *plget;
 
 #define CONTROL_LEN			512
 
+#ifndef SO_INCOMING_NAPI_ID
+#define SO_INCOMING_NAPI_ID		56
+#endif
+
+#ifndef PACKET_FANOUT_HASH
+#define PACKET_FANOUT_HASH		0
+#define PACKET_FANOUT_CPU		2
+#define PACKET_FANOUT_QM		5
+#endif
+
 enum pkt_type {
 	PKT_UDP = 1,
 	PKT_ETH,
@@ -89,18 +141,48 @@ enum test_mod {
 	RX_RATE = 6,
 };
 
+/* rx sequence info, by packet id */
+struct rx_seq {
+	__u8 *seen;		/* ids received already */
+	__u32 next_id;		/* highest received id + 1 */
+	__u32 reorder_max;	/* max reorder distance */
+	unsigned long reorder;	/* came after packet with higher id */
+	unsigned long late;	/* reordered more than RX_LATE_DIST */
+	unsigned long dup;
+	unsigned long invalid;	/* id is out of range */
+	unsigned long corrupt;	/* payload crc mismatch, see -o crc */
+};
+
+/* rx vectors and own id space of one sender stream, see -o streams */
+struct rx_stream {
+	struct stats app_v;
+	struct stats sw_v;
+	struct stats hw_v;
+	struct stats snd_v;
+	struct rx_seq seq;
+};
+
 struct plgett {
 	union {
 		struct in_addr iaddr;
+		struct in6_addr iaddr6;
 		struct sockaddr_ll iaddr2;
 		struct sockaddr_xdp iaddr3;
 	};
 	struct ether_addr macaddr;
 	struct ether_addr if_addr;
-	struct sockaddr_ll sk_addr;
+	union {
+		struct in_addr if_iaddr;
+		struct in6_addr if_iaddr6;
+	};
+	union {
+		struct sockaddr_ll sk_addr;
+		struct sockaddr_in6 sk_addr6;
+	};
+	socklen_t sk_addr_len;
 	enum test_mod mod;
 	struct timespec interval;
-	struct timespec rtime;
+	__u64 rtime;
 	char if_name[IFNAMSIZ];
 	int ifidx;
 	enum pkt_type pkt_type;
@@ -109,13 +191,24 @@ struct plgett {
 	int sk_payload_size;	/* socket payload size */
 	int sfd;
 	int port;
-	int flags;
+	unsigned long long flags;
 	int prio;
 	int queue;		/* must be used by XDP socket */
 	int busypoll_time;
+	int busypoll_budget;	/* prefer busy poll with this budget if set */
+	int epfd;		/* epoll instance to wait for ingress packets */
+	__u64 spin_time;	/* adaptive poll spin in ns, 0 - self tuning */
 	int stream_id;
+	int vlan_num;		/* number of vlan tags, 2 for QinQ */
+	__u16 vlan_tci[VLAN_MAX_NUM];	/* pcp and vid, outer tag first */
 	int dev_deep;
+	int batch;		/* number of packets received per syscall */
+	int fanout_mode;	/* PACKET_FANOUT_* mode */
+	int fanout_num;		/* number of fanout workers */
+	int idle_timeout;	/* ms w/o new packets to end rx-lat, 0 - none */
 	int timer_fd;
+	char *capture;		/* pcapng file, see -C */
+	int snaplen;		/* bytes of frame captured */
 	struct xsock *xsk;	/* xdp soket info */
 
 	/* rt print */
@@ -127,19 +220,99 @@ struct plgett {
 	char *rx_pkt;
 	int off_sid_wr;		/* PTP sequential id */
 	int off_tid_wr;		/* wr offset for ts id for identification */
-	int off_tid_rd;		/* rd offset for ts id for identification */
-	int off_magic_rd;	/* rd offset for magic num for validation */
+	int off_ts_wr;		/* wr offset for sender ts, see -o tx_ts */
+	int off_magic_pl;	/* magic offset in payload, behind PTP header */
+	int off_sid_rd;		/* stream id offset relative to magic */
+	int hdr_size;		/* size of headers built for raw frames */
+	int off_csum;		/* l4 csum offset, 0 if no need to update */
+	__u32 csum_base;	/* partial l4 csum of template w/o sid, tid, crc */
+	int off_crc;		/* payload crc32c offset, 0 if no crc */
+	__u32 seed;		/* seed of payload pattern */
 
 	/* rx packet related info */
 	char data[ETH_DATA_LEN];
 	char control[CONTROL_LEN];
 	struct iovec iov;
 	struct msghdr msg;
-	int off_tid_rx_rd;	/* rx rd offset for ts id for identification */
-	int off_magic_rx_rd;	/* rx rd offset magic num for validation */
+	struct mmsghdr *mmsg;	/* batch of rx messages, see -b */
+	int rx_off;		/* magic offset in current rx packet */
+	int rx_len;		/* size of current rx packet */
+	int rx_l3_off;		/* outer ip header of current raw rx frame */
+	int rx_l4_off;		/* outer l4 header of current raw rx frame */
+
+	/* adaptive poll info */
+	__u64 spin_budget;	/* current spin time in ns */
+	__u64 wait_avg;		/* average wait for packet in ns */
+	int rx_group;		/* RX_GROUP_* of current packet */
+	__u8 *rx_groups;	/* RX_GROUP_* of every packet by id */
+	unsigned long spin_cnt;
+	unsigned long block_cnt;
+
+	/* softirq cpu and napi instance of every packet by id */
+	__u32 *rx_cpus;
+	__u32 *rx_napis;
+	struct sockaddr_in6 rx_peer;	/* source of packet, for connect */
+	int rx_connected;
+
+	/* rx sequence info, invalid ones are of unknown stream with streams */
+	struct rx_seq rx_seq;
+	struct rx_stream *rx_streams;	/* STREAM_NUM streams if demuxed */
+	struct rx_stream *rx_strm;	/* stream of current packet */
+	unsigned long idle_icnt;	/* icnt on last idle timer tick */
+	volatile int rx_idle;		/* rx-lat is ended by idle timeout */
+	/* ids of every run of sweep are counted from first one received */
+	__u32 rx_id_base;
+	int rx_rebase;
+
+	/* rx-usecs of interrupt coalescing sweep, see -W */
+	__u32 coal_usecs[COAL_SWEEP_MAX];
+	int coal_num;
+
+	int hist_bits;			/* sub-buckets of histograms, see -H */
 };
 
+/* self tuned spin is limited, longer gaps are not worth to spin */
+#define SPIN_MIN_NS			1000
+#define SPIN_MAX_NS			50000
+
+/* packet reordered more than this is late, it's lost for reorder buffer */
+#define RX_LATE_DIST			16
+#define RX_IDLE_TIMEOUT			5000
+
+/* how adaptive poll got the packet */
+#define RX_GROUP_SPIN			1
+#define RX_GROUP_BLOCK			2
+
 int setup_sock(int sfd, int flags);
+int plget_init_worker(void);
+
+/* size of ethernet header including vlan tags */
+static inline int eth_hlen(void)
+{
+	return ETH_HLEN + VLAN_HLEN * plget->vlan_num;
+}
+
+/* size of ip + udp headers */
+static inline int ip_udp_hlen(void)
+{
+	return (plget->flags & PLF_IPV6 ? IPV6_HLEN : IPV4_HLEN) + UDPH_LEN;
+}
+
+static inline int plget_iaddr_set(void)
+{
+	if (plget->flags & PLF_IPV6)
+		return !IN6_IS_ADDR_UNSPECIFIED(&plget->iaddr6);
+
+	return !!plget->iaddr.s_addr;
+}
+
+static inline int plget_iaddr_mcast(void)
+{
+	if (plget->flags & PLF_IPV6)
+		return IN6_IS_ADDR_MULTICAST(&plget->iaddr6);
+
+	return IN_MULTICAST(ntohl(plget->iaddr.s_addr));
+}
 
 int plget_create_timer(void);
 int plget_start_timer(void);
@@ -150,12 +323,45 @@ struct stats *plget_best_tx_vect(void);
 
 static inline char *magic_rx_rd(void)
 {
-	return (char *)(plget->rx_pkt + plget->off_magic_rx_rd);
+	return plget->rx_pkt + plget->rx_off;
 }
 
-static inline char *magic_rd(void)
+/* crc32c of payload from PTP header or magic, it's last 4 bytes of packet */
+static inline void crc_wr(void)
 {
-	return (char *)(plget->data + plget->off_magic_rd);
+	__u32 crc;
+
+	crc = crc32c(plget->pkt + plget->hdr_size,
+		     plget->off_crc - plget->hdr_size);
+	crc = htonl(crc);
+	memcpy(plget->pkt + plget->off_crc, &crc, sizeof(crc));
+}
+
+/* update l4 checksum of raw frame, sid, tid and crc are fields that differ */
+static inline void csum_wr(void)
+{
+	__u32 sum = plget->csum_base;
+	char *pkt = plget->pkt;
+	__u16 csum;
+
+	sum = csum_add(sum, pkt + plget->off_tid_wr, sizeof(__u32),
+		       plget->off_tid_wr);
+
+	if (plget->flags & PLF_PTP)
+		sum = csum_add(sum, pkt + plget->off_sid_wr, sizeof(__u16),
+			       plget->off_sid_wr);
+
+	if (plget->flags & PLF_TX_TS)
+		sum = csum_add(sum, pkt + plget->off_ts_wr, sizeof(__u64),
+			       plget->off_ts_wr);
+
+	if (plget->off_crc)
+		sum = csum_add(sum, pkt + plget->off_crc, CRC_LEN,
+			       plget->off_crc);
+
+	csum = csum_fold(sum);
+	csum = htons(csum ? csum : 0xffff);
+	memcpy(pkt + plget->off_csum, &csum, sizeof(csum));
 }
 
 static inline void tid_wr(__u32 tid)
@@ -165,16 +371,28 @@ static inline void tid_wr(__u32 tid)
 	p = (char *)(plget->off_tid_wr + plget->pkt);
 	tid = htonl(tid);
 	memcpy(p, &tid, sizeof(tid));
+
+	if (plget->off_crc)
+		crc_wr();
+
+	if (plget->off_csum)
+		csum_wr();
 }
 
-static inline __u32 tid_rd(void)
+/* sender ts in ns, it has to be written before tid to be in crc and csum */
+static inline void tx_ts_wr(struct timespec *ts)
 {
-	__u32 tid;
-	char *p;
+	__u64 ns = htobe64(ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec);
 
-	p = (char *)(plget->data + plget->off_tid_rd);
+	memcpy(plget->pkt + plget->off_ts_wr, &ns, sizeof(ns));
+}
 
-	memcpy(&tid, p, sizeof(tid));
+/* ts id follows magic */
+static inline __u32 tid_rd(const char *magic)
+{
+	__u32 tid;
+
+	memcpy(&tid, magic + 1, sizeof(tid));
 	tid = ntohl(tid);
 
 	return tid;
@@ -182,15 +400,29 @@ static inline __u32 tid_rd(void)
 
 static inline __u32 tid_rx_rd(void)
 {
-	__u32 tid;
-	char *p;
+	return tid_rd(magic_rx_rd());
+}
+
+/* stream id of rx packet, PTP sequenceId high bits or byte after ts id */
+static inline int sid_rx_rd(void)
+{
+	__u8 sid = plget->rx_pkt[plget->rx_off + plget->off_sid_rd];
 
-	p = (char *)(plget->rx_pkt + plget->off_tid_rx_rd);
+	if (plget->flags & PLF_PTP)
+		return sid >> (STREAM_ID_SHIFT - 8);
 
-	memcpy(&tid, p, sizeof(tid));
-	tid = ntohl(tid);
+	return sid;
+}
 
-	return tid;
+/* sender ts of rx packet in ns, zero if packet is too short to have it */
+static inline __u64 tx_ts_rx_rd(void)
+{
+	__u64 ns = 0;
+
+	if (plget->rx_off + PL_TX_TS_OFF + (int)sizeof(ns) <= plget->rx_len)
+		memcpy(&ns, magic_rx_rd() + PL_TX_TS_OFF, sizeof(ns));
+
+	return be64toh(ns);
 }
 
 static inline void sid_wr(__u16 sid)
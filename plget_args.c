@@ -18,14 +18,22 @@
 #include <stdio.h>
 #include <arpa/inet.h>
 #include <string.h>
+#include <unistd.h>
 #include "xdp_prog_load.h"
+#include "uring.h"
+#include "pcap.h"
+
+static int iaddr4_set;
 
 #define PLGET_NAME_VER			"plget v0.5"
 #define PTP_EVENT_PORT			319
 #define PTP_GENERAL_PORT		320
 #define PTP_PRIMARY_MCAST_IPADDR	"224.0.1.129"
+#define PTP_PRIMARY_MCAST_IP6ADDR	"ff0e::181"
 #define PTP_PRIMARY_MCAST_MACADDR	"01:1B:19:00:00:00"
 #define PTP_FILTERED_MCAST_MACADDR	"01:80:C2:00:00:0E"
+#define RX_RATE_BATCH			64
+#define RX_BATCH_MAX			1024
 
 static void plget_usage(FILE *s)
 {
@@ -37,10 +45,11 @@ fprintf(s, "\ts PPS \t\t--pps=PPS\t\t:packets per second, no need in "
 
 fprintf(s, "\tu PORT\t\t--udp=PORT\t\t:udp port number for udp packet type\n");
 fprintf(s, "\t\t\t\t\t\tport 319 or 320 is special and address 224.0.1.29 "
-	"by default if not overwritten\n");
+	"(ff0e::181 for ipv6) by default if not overwritten\n");
 
 fprintf(s, "\tt TYPE\t\t--type=TYPE\t\t:type of packet, can be udp, avtp, "
-	"ptpl2, ptpl4, xdp_ptpl2, raw_ptpl2\n");
+	"ptpl2, ptpl4, xdp_ptpl2, raw_ptpl2, xdp_udp, xdp_ptpl4, raw_udp, "
+	"raw_ptpl4\n");
 fprintf(s, "\ti NAME\t\t--if=NAME\t\t:interface name\n");
 fprintf(s, "\tm MODE\t\t--mode=MODE\t\t:\"rx-lat\" or \"tx-lat\" or "
 	"\"echo-lat\" or \"pkt-gen\" or \"rtt\" or \"rx-rate\" mode\n");
@@ -50,6 +59,8 @@ fprintf(s, "\tl SIZE\t\t--frame-size=SIZE\t:packet frame size (total) in "
 	"bytes\n");
 fprintf(s, "\ta ADDR\t\t--address=ADDR\t\t:ip or mac address depending on the "
 	"mode\n");
+fprintf(s, "\tA ADDR\t\t--ip-address=ADDR\t:ip address for raw and xdp "
+	"udp/ptpl4 frames, -a is mac address then\n");
 fprintf(s, "\tc \t\t--clock-check\t\t:print title along with system and "
 	"ptp clock counts, no arguments\n");
 
@@ -67,10 +78,21 @@ fprintf(s, "\t\t\t\t\t\t\"sched\" - print latencies before packet scheduler\n");
 fprintf(s, "\tp PRIO\t\t--prio=PRIO\t\t:set priority for socket\n");
 fprintf(s, "\tw TIME\t\t--busy-poll=TIME\t:set SO_BUSY_POLL option for "
 	"socket, in us\n");
+fprintf(s, "\tB NUM\t\t--busy-budget=NUM\t:epoll busy poll with "
+	"SO_PREFER_BUSY_POLL and NUM packets budget, -w sets time\n");
+fprintf(s, "\tS TIME\t\t--spin=TIME\t\t:adaptive poll with fixed spin "
+	"time before blocking, in us\n");
+fprintf(s, "\tT TIME\t\t--idle-timeout=TIME\t:end \"rx-lat\" if no new "
+	"packets for TIME, first one including, in ms, %d by default, 0 - "
+	"never\n", RX_IDLE_TIMEOUT);
 fprintf(s, "\tr TIME\t\t--rel-time=TIME\t\t:use relative time for \"hwts\" "
 	"output instead of first packet timestamp, in ns\n");
 fprintf(s, "\tk ID\t\t--stream-id=ID\t\t:set stream num to identify PTP "
 	"stream (with seq_id) to differ on h/w level\n");
+fprintf(s, "\t\t\t\t\t\tfor other types it's put in payload, see "
+	"\"streams\" option\n");
+fprintf(s, "\tP SEED\t\t--seed=SEED\t\t:seed of payload pattern, same "
+	"seed gives same payload, 1 by default\n");
 
 fprintf(s, "\td NUM\t\t--dev-deep=NUM\t\t:number of devices on tx path to "
 	"get latencies between, used only for\n");
@@ -80,6 +102,40 @@ fprintf(s, "\t\t\t\t\t\tThat is, if vlan + bridge then -d 3, and so on, "
 	"basically it's equal to\n");
 fprintf(s, "\t\t\t\t\t\tnumber of sched timestamps expected\n");
 
+fprintf(s, "\tv VLAN\t\t--vlan=VLAN\t\t:insert vlan tag VID[:PCP] in raw "
+	"and xdp frames, VID[:PCP],VID[:PCP] for QinQ\n");
+fprintf(s, "\t\t\t\t\t\touter tag is 802.1ad one, on rx side means tagged "
+	"frames are expected\n");
+
+fprintf(s, "\tb NUM\t\t--batch=NUM\t\t:number of packets received per "
+	"syscall with recvmmsg(), \"rx-lat\" and \"rx-rate\" modes\n");
+fprintf(s, "\t\t\t\t\t\tby default 1 for \"rx-lat\" and %d for "
+	"\"rx-rate\", app ts is taken once per batch\n", RX_RATE_BATCH);
+fprintf(s, "\t\t\t\t\t\tfor \"pkt-gen\" with io_uring it's number of "
+	"sends per submit, up to and by default %d\n", URING_TX_NUM);
+
+fprintf(s, "\tF MODE[:NUM]\t--fanout=MODE[:NUM]\t:receive with NUM threads "
+	"pinned to cpus, each with own socket\n");
+fprintf(s, "\t\t\t\t\t\tjoined to PACKET_FANOUT group, MODE is \"hash\", "
+	"\"cpu\" or \"qm\", NUM is number of cpus by default\n");
+fprintf(s, "\t\t\t\t\t\tfor udp sockets SO_REUSEPORT group is used, "
+	"\"cpu\" attaches cbpf steering to worker of rx cpu\n");
+
+fprintf(s, "\tC FILE[:LEN]\t--capture=FILE[:LEN]\t:write received frames "
+	"with their timestamps to pcapng FILE, LEN bytes of each\n");
+fprintf(s, "\t\t\t\t\t\tup to and by default %d, \"tx-lat\" writes "
+	"transmitted ones, see \"capture_tx\" option\n", PCAP_SNAPLEN);
+
+fprintf(s, "\tW USECS,..\t--coal-sweep=USECS,..\t:run \"rx-lat\" for "
+	"every rx-usecs of interrupt coalescing, up to %d, -n packets each\n",
+	COAL_SWEEP_MAX);
+fprintf(s, "\t\t\t\t\t\toriginal setting is restored then, sets "
+	"\"coal\" option\n");
+
+fprintf(s, "\tH DIGITS\t--hist-digits=DIGITS\t:significant digits of "
+	"latency percentiles, 1 - %d, %d by default\n", STATS_HIST_DIGITS_MAX,
+	STATS_HIST_DIGITS);
+
 fprintf(s, "\tq QUEUE\t\t--queue=QUEUE\t\t:set queue for xpd socket\n");
 fprintf(s, "\tz \t\t--zero-copy\t\t:force zero-copy XDP mode (not tested)\n");
 
@@ -92,6 +148,37 @@ fprintf(s, "\t\t\t\t\t\t\"progress\" - print progress bar while running\n");
 fprintf(s, "\t\t\t\t\t\t\"sw_poll\" - software poll of ingress packets, "
 	"DONTWAIT flag if recvmsg is used, for af_xdp it's polling of "
 	"rx queue. Can consume CPU time and power.\n");
+fprintf(s, "\t\t\t\t\t\t\"ipv6\" - use ipv6 for udp packets, ptp default "
+	"address is ff0e::181, set also if ipv6 address is given\n");
+fprintf(s, "\t\t\t\t\t\t\"epoll\" - wait for ingress packets with "
+	"epoll, irq driven unless -B is set\n");
+fprintf(s, "\t\t\t\t\t\t\"adaptive\" - spin on DONTWAIT recvmsg and "
+	"block then, spin time is self tuned unless -S is set\n");
+fprintf(s, "\t\t\t\t\t\t\"rx_ring\" - receive via TPACKET_V3 mmaped "
+	"ring in \"rx-lat\" and \"rx-rate\" modes, for packet sockets\n");
+fprintf(s, "\t\t\t\t\t\t\"io_uring\" - socket i/o via io_uring, "
+	"multishot recvmsg for \"rx-lat\" and \"rx-rate\", sends for "
+	"\"tx-lat\" and \"pkt-gen\"\n");
+fprintf(s, "\t\t\t\t\t\t\"sqpoll\" - io_uring with kernel thread "
+	"polling submission queue, sets \"io_uring\"\n");
+fprintf(s, "\t\t\t\t\t\t\"streams\" - demux packets by stream id of "
+	"sender (-k), each stream has own stats and ids\n");
+fprintf(s, "\t\t\t\t\t\t\"rx_cpu\" - get rx cpu and napi id of every "
+	"udp packet in \"rx-lat\", stack latency is printed per each\n");
+fprintf(s, "\t\t\t\t\t\t\"crc\" - crc32c of payload in last 4 bytes, "
+	"written by sender, corrupted packets are counted and dropped by "
+	"receiver\n");
+fprintf(s, "\t\t\t\t\t\t\"capture_tx\" - capture also transmitted "
+	"frames in \"rtt\" and \"echo-lat\", per each tx timestamp\n");
+fprintf(s, "\t\t\t\t\t\t\"tx_ts\" - sender app ts in payload, "
+	"set by \"tx-lat\" and \"pkt-gen\", \"rx-lat\" prints one-way "
+	"latency,\n");
+fprintf(s, "\t\t\t\t\t\tjitter of \"rx-rate\" is taken from "
+	"transit time then\n");
+fprintf(s, "\t\t\t\t\t\t\"coal\" - find packets handled in one "
+	"irq, print batch size, delay and effective rx-usecs\n");
+fprintf(s, "\t\t\t\t\t\t\"hist\" - count \"rx-lat\" latencies in "
+	"histograms as packets come, no timestamps are stored per packet\n");
 }
 
 static struct option plget_options[] = {
@@ -103,14 +190,25 @@ static struct option plget_options[] = {
 	{"pkt-num",	required_argument,	0, 'n'},
 	{"frame-size",	required_argument,	0, 'l'},
 	{"address",	required_argument,	0, 'a'},
+	{"ip-address",	required_argument,	0, 'A'},
 	{"clock-check",	no_argument,		0, 'c'},
 	{"format",	required_argument,	0, 'f'},
 	{"prio",	required_argument,	0, 'p'},
 	{"busy-poll",	required_argument,	0, 'w'},
+	{"busy-budget",	required_argument,	0, 'B'},
+	{"spin",	required_argument,	0, 'S'},
+	{"idle-timeout", required_argument,	0, 'T'},
 	{"rel-time",	required_argument,	0, 'r'},
 	{"stream-id",	required_argument,	0, 'k'},
+	{"seed",	required_argument,	0, 'P'},
 	{"dev-deep",	required_argument,	0, 'd'},
 	{"queue",	required_argument,	0, 'q'},
+	{"vlan",	required_argument,	0, 'v'},
+	{"batch",	required_argument,	0, 'b'},
+	{"fanout",	required_argument,	0, 'F'},
+	{"capture",	required_argument,	0, 'C'},
+	{"coal-sweep",	required_argument,	0, 'W'},
+	{"hist-digits",	required_argument,	0, 'H'},
 	{"zero-copy",	no_argument,		0, 'z'},
 	{"help",	no_argument,		0, 'h'},
 	{"option",	required_argument,	0, 'o'},
@@ -145,6 +243,74 @@ static void plget_set_ptp_default_macaddr(void)
 	}
 }
 
+static void plget_set_ptp_default_iaddr(void)
+{
+	char *addr;
+
+	if (plget_iaddr_set() || !(plget->flags & PLF_PTP))
+		return;
+
+	if (plget->flags & PLF_IPV6) {
+		addr = PTP_PRIMARY_MCAST_IP6ADDR;
+		inet_pton(AF_INET6, addr, &plget->iaddr6);
+	} else {
+		addr = PTP_PRIMARY_MCAST_IPADDR;
+		inet_aton(addr, &plget->iaddr);
+	}
+
+	printf("Destination address is set to %s\n", addr);
+}
+
+/* map ip multicast address on mac multicast address */
+static void plget_set_mcast_macaddr(void)
+{
+	__u8 *mac = (__u8 *)&plget->macaddr;
+	__u32 addr = ntohl(plget->iaddr.s_addr);
+
+	plget->flags |= PLF_ADDR_SET;
+
+	if (plget->flags & PLF_IPV6) {
+		mac[0] = 0x33;
+		mac[1] = 0x33;
+		memcpy(&mac[2], &plget->iaddr6.s6_addr[12], 4);
+		return;
+	}
+
+	mac[0] = 0x01;
+	mac[1] = 0x00;
+	mac[2] = 0x5e;
+	mac[3] = (addr >> 16) & 0x7f;
+	mac[4] = (addr >> 8) & 0xff;
+	mac[5] = addr & 0xff;
+}
+
+static int plget_check_raw_udp(void)
+{
+	int mod = plget->mod;
+
+	if (!(plget->flags & PLF_RAW_UDP)) {
+		if (plget->port)
+			plget_fail("UDP (-u) requires raw_udp or xdp_udp type");
+
+		plget_set_ptp_default_macaddr();
+		return 0;
+	}
+
+	if (!plget->port)
+		plget_fail("Please, specify UDP port number");
+
+	if (plget->port == PTP_EVENT_PORT || plget->port == PTP_GENERAL_PORT)
+		plget->flags |= PLF_PTP;
+
+	plget_set_ptp_default_iaddr();
+
+	if (!(plget->flags & PLF_ADDR_SET) && plget_iaddr_mcast())
+		plget_set_mcast_macaddr();
+
+	return !plget_iaddr_set() && (mod == TX_LAT || mod == RTT_MOD ||
+				      mod == PKT_GEN);
+}
+
 static void plget_check_args(void)
 {
 	int mod = plget->mod;
@@ -178,9 +344,138 @@ static void plget_check_args(void)
 		       "this mode\n");
 	}
 
+	if (plget->vlan_num && plget->pkt_type != PKT_RAW &&
+	    plget->pkt_type != PKT_XDP)
+		plget_fail("vlan tags can be inserted only in raw or xdp "
+			   "frames, use vlan interface instead");
+
+	if (iaddr4_set && plget->flags & PLF_IPV6)
+		plget_fail("ipv4 address cannot be used for ipv6");
+
+	if (plget->flags & PLF_IPV6 && plget->pkt_type != PKT_UDP &&
+	    !(plget->flags & PLF_RAW_UDP))
+		plget_fail("ipv6 can be used only for udp packets");
+
 	if (mod == RX_LAT && ts_correct(&plget->interval))
 		plget_fail("pps cannot be set in rx-lat mode");
 
+	if (plget->batch > 1 && ((mod != RX_LAT && mod != RX_RATE) ||
+	    plget->pkt_type == PKT_XDP) &&
+	    !(mod == PKT_GEN && plget->flags & PLF_URING))
+		plget_fail("batch can be used only for rx-lat and rx-rate with "
+			   "sockets or for pkt-gen with io_uring");
+
+	if (plget->flags & PLF_RX_RING) {
+		if ((mod != RX_LAT && mod != RX_RATE) ||
+		    (plget->pkt_type != PKT_RAW && plget->pkt_type != PKT_ETH))
+			plget_fail("rx ring can be used only for rx-lat and "
+				   "rx-rate with packet sockets");
+
+		if (plget->batch > 1)
+			plget_fail("batch cannot be used with rx ring");
+	}
+
+	if (plget->flags & PLF_FANOUT) {
+		if ((mod != RX_LAT && mod != RX_RATE) ||
+		    plget->pkt_type == PKT_XDP)
+			plget_fail("fanout can be used only for rx-lat and "
+				   "rx-rate with sockets");
+
+		if (plget->pkt_type == PKT_UDP &&
+		    plget->fanout_mode == PACKET_FANOUT_QM)
+			plget_fail("qm fanout mode is only for packet sockets");
+	}
+
+	if (plget->flags & PLF_EPOLL && plget->pkt_type == PKT_XDP)
+		plget_fail("epoll cannot be used for af_xdp, use sw_poll");
+
+	if (plget->busypoll_budget && !(plget->flags & PLF_BUSYPOLL))
+		plget_fail("busy poll budget needs busy poll time, set -w");
+
+	if (plget->busypoll_budget < 0 || plget->busypoll_budget > 0xffff)
+		plget_fail("Invalid busy poll budget");
+
+	if (plget->flags & PLF_ADAPTIVE &&
+	    (mod == RX_RATE || plget->pkt_type == PKT_XDP ||
+	     plget->flags & (PLF_RX_RING | PLF_SW_POLL) || plget->batch > 1))
+		plget_fail("adaptive poll is only for recvmsg of one packet, "
+			   "not for rx-rate, af_xdp, rx_ring, batch or sw_poll");
+
+	if (plget->flags & PLF_URING) {
+		if ((mod != RX_LAT && mod != RX_RATE && mod != TX_LAT &&
+		     mod != PKT_GEN) || plget->pkt_type == PKT_XDP)
+			plget_fail("io_uring can be used only for rx-lat, "
+				   "rx-rate, tx-lat and pkt-gen with sockets");
+
+		if (plget->flags & (PLF_RX_RING | PLF_EPOLL | PLF_ADAPTIVE |
+				    PLF_FANOUT) ||
+		    (mod != PKT_GEN && plget->batch > 1))
+			plget_fail("io_uring cannot be used with rx_ring, "
+				   "epoll, adaptive, fanout or rx batch");
+
+		if (plget->batch > URING_TX_NUM)
+			plget_fail("io_uring batch has to be in range 1 - 64");
+	}
+
+	if (!plget->batch && mod == PKT_GEN && plget->flags & PLF_URING)
+		plget->batch = URING_TX_NUM;
+	else if (!plget->batch)
+		plget->batch = mod == RX_RATE ? RX_RATE_BATCH : 1;
+
+	if (plget->flags & PLF_STREAMS &&
+	    ((mod != RX_LAT && mod != RX_RATE) ||
+	     plget->flags & (PLF_FANOUT | PLF_ADAPTIVE)))
+		plget_fail("streams can be demuxed only in rx-lat and rx-rate, "
+			   "not with fanout or adaptive poll");
+
+	if (plget->flags & PLF_RX_CPU &&
+	    (mod != RX_LAT || plget->pkt_type != PKT_UDP || plget->batch > 1 ||
+	     plget->flags & (PLF_URING | PLF_STREAMS | PLF_FANOUT)))
+		plget_fail("rx cpu is only for rx-lat of udp socket with "
+			   "recvmsg of one packet, not for batch, io_uring, "
+			   "streams or fanout");
+
+	if (mod == TX_LAT && plget->flags & PLF_CAPTURE)
+		plget->flags |= PLF_CAPTURE_TX;
+
+	if (plget->flags & PLF_CAPTURE &&
+	    (mod == RX_RATE || mod == PKT_GEN || plget->flags & PLF_FANOUT))
+		plget_fail("capture is not for rx-rate, pkt-gen or fanout");
+
+	if (plget->flags & PLF_CAPTURE_TX && !(plget->flags & PLF_CAPTURE))
+		plget_fail("capture_tx needs capture file to be set with -C");
+
+	if (plget->flags & PLF_TX_TS && mod != TX_LAT && mod != PKT_GEN &&
+	    mod != RX_LAT && mod != RX_RATE)
+		plget_fail("sender ts is only for tx-lat, pkt-gen, rx-lat and "
+			   "rx-rate");
+
+	if (plget->flags & PLF_COAL && mod != RX_LAT && mod != ECHO_LAT &&
+	    mod != RTT_MOD)
+		plget_fail("coalescing is analyzed only in rx-lat, echo-lat "
+			   "and rtt modes");
+
+	if (plget->coal_num &&
+	    (mod != RX_LAT || plget->pkt_type == PKT_XDP ||
+	     plget->flags & (PLF_FANOUT | PLF_STREAMS | PLF_RX_RING |
+			     PLF_URING)))
+		plget_fail("coalescing sweep is only for rx-lat on socket w/o "
+			   "fanout, streams, rx_ring and io_uring");
+
+	if (plget->flags & PLF_COAL && !(plget->flags & PLF_PRINTOUT))
+		plget_fail("coalescing is analyzed on timestamps, don't "
+			   "disable printout");
+
+	if (plget->flags & PLF_HIST &&
+	    (mod != RX_LAT ||
+	     plget->flags & (PLF_STREAMS | PLF_COAL | PLF_RX_CPU |
+			     PLF_HW_STAT | PLF_IPGAP_STAT)))
+		plget_fail("histograms are only for rx-lat latencies, not with "
+			   "streams, coal, rx_cpu, hw time or gap stats");
+
+	if (plget->flags & PLF_CRC && mod == RX_RATE)
+		plget_fail("crc is not checked in rx-rate mode");
+
 	if ((mod == RX_LAT || mod == RX_RATE) && plget->flags & PLF_PRIO)
 		plget_fail("priority cannot be set in this mode");
 
@@ -198,14 +493,9 @@ static void plget_check_args(void)
 		    plget->port == PTP_GENERAL_PORT)
 			plget->flags |= PLF_PTP;
 
-		if (!plget->iaddr.s_addr && plget->flags & PLF_PTP) {
-			inet_aton(PTP_PRIMARY_MCAST_IPADDR, &plget->iaddr);
-			if (!(mod == RX_LAT && mod == RX_RATE))
-				printf("Destination address is set to %s\n",
-					PTP_PRIMARY_MCAST_IPADDR);
-		}
+		plget_set_ptp_default_iaddr();
 
-		need_addr = (!plget->iaddr.s_addr) && (mod == TX_LAT ||
+		need_addr = !plget_iaddr_set() && (mod == TX_LAT ||
 			    mod == ECHO_LAT || mod == RTT_MOD ||
 			    mod == PKT_GEN);
 		break;
@@ -219,13 +509,10 @@ static void plget_check_args(void)
 			printf("Cannot specify port for non UDP packets\n");
 		break;
 	case PKT_XDP:
-		if (mod == RX_RATE || mod == PKT_GEN)
+		if (mod == PKT_GEN)
 			plget_fail("Mode is not supported for af_xdp for now");
 
-		if (plget->port)
-			plget_fail("UDP (-u) is not supported for raw af_xdp sockets for now");
-
-		plget_set_ptp_default_macaddr();
+		need_addr = plget_check_raw_udp();
 
 		if (plget->if_name[0] == '\0')
 			plget_fail("For XDP sockets, dev has to be specified");
@@ -233,17 +520,17 @@ static void plget_check_args(void)
 		if (!(plget->flags & PLF_QUEUE))
 			plget->queue = 0;
 
-		need_addr = (!(plget->flags & PLF_ADDR_SET)) &&
-			    (mod == TX_LAT || mod == RTT_MOD || mod == PKT_GEN);
+		need_addr |= (!(plget->flags & PLF_ADDR_SET)) &&
+			     (mod == TX_LAT || mod == RTT_MOD || mod == PKT_GEN);
 		break;
 	case PKT_RAW:
-		plget_set_ptp_default_macaddr();
+		need_addr = plget_check_raw_udp();
 
 		if (plget->if_name[0] == '\0')
 			plget_fail("For RAW sockets, dev has to be specified");
 
-		need_addr = (!(plget->flags & PLF_ADDR_SET)) &&
-			    (mod == TX_LAT || mod == RTT_MOD || mod == PKT_GEN);
+		need_addr |= (!(plget->flags & PLF_ADDR_SET)) &&
+			     (mod == TX_LAT || mod == RTT_MOD || mod == PKT_GEN);
 		break;
 	default:
 		plget_fail("Please, specify packet_type");
@@ -251,6 +538,16 @@ static void plget_check_args(void)
 
 	if (need_addr)
 		plget_fail("Please, specify the address with -a");
+
+	/* every socket of reuseport group gets own copy of mcast packet */
+	if (plget->flags & PLF_FANOUT && plget->pkt_type == PKT_UDP &&
+	    plget_iaddr_mcast())
+		plget_fail("udp fanout cannot be used for multicast");
+
+	/* connected udp socket gets packets of one source only */
+	if (plget->flags & PLF_RX_CPU && plget->pkt_type == PKT_UDP &&
+	    plget_iaddr_mcast())
+		plget_fail("rx cpu cannot be used for multicast");
 }
 
 static void plget_set_pps(void)
@@ -296,10 +593,32 @@ static void plget_set_packet_type(void)
 		plget->flags |= PLF_PTP;
 #else
 		plget_fail("use \"make AFXDP=1\" to build have xdp_ptpl2");
+#endif
+	} else if (!strcmp("xdp_udp", optarg)) {
+#ifdef CONF_AFXDP
+		plget->pkt_type = PKT_XDP;
+		plget->flags |= PLF_RAW_UDP;
+#else
+		plget_fail("use \"make AFXDP=1\" to build have xdp_udp");
+#endif
+	} else if (!strcmp("xdp_ptpl4", optarg)) {
+#ifdef CONF_AFXDP
+		plget->pkt_type = PKT_XDP;
+		plget->flags |= PLF_RAW_UDP;
+		plget->port = PTP_EVENT_PORT;
+#else
+		plget_fail("use \"make AFXDP=1\" to build have xdp_ptpl4");
 #endif
 	} else if (!strcmp("raw_ptpl2", optarg)) {
 		plget->pkt_type = PKT_RAW;
 		plget->flags |= PLF_PTP;
+	} else if (!strcmp("raw_udp", optarg)) {
+		plget->pkt_type = PKT_RAW;
+		plget->flags |= PLF_RAW_UDP;
+	} else if (!strcmp("raw_ptpl4", optarg)) {
+		plget->pkt_type = PKT_RAW;
+		plget->flags |= PLF_RAW_UDP;
+		plget->port = PTP_EVENT_PORT;
 	} else {
 		plget_fail("unsupported packet type");
 	}
@@ -323,13 +642,27 @@ static void plget_set_mode(void)
 		plget_fail("unkown mode");
 }
 
+/* ipv6 address switches to ipv6 */
+static void plget_parse_iaddr(void)
+{
+	if (inet_pton(AF_INET6, optarg, &plget->iaddr6) == 1) {
+		plget->flags |= PLF_IPV6;
+		return;
+	}
+
+	if (inet_pton(AF_INET, optarg, &plget->iaddr) != 1)
+		plget_fail("Invalid ip address");
+
+	iaddr4_set = 1;
+}
+
 static void plget_set_address(void)
 {
 	__u8 *mac = (__u8 *)&plget->macaddr;
 	int ret;
 
 	if (plget->pkt_type == PKT_UDP) {
-		inet_aton(optarg, &plget->iaddr);
+		plget_parse_iaddr();
 	} else if (plget->pkt_type == PKT_ETH ||
 		   plget->pkt_type == PKT_XDP ||
 		   plget->pkt_type == PKT_RAW) {
@@ -347,6 +680,11 @@ static void plget_set_address(void)
 	plget->flags |= PLF_ADDR_SET;
 }
 
+static void plget_set_ip_address(void)
+{
+	plget_parse_iaddr();
+}
+
 static void plget_set_output_format(void)
 {
 	if (strstr(optarg, "hwts"))
@@ -380,6 +718,45 @@ static void plget_set_option(void)
 
 	if (strstr(optarg, "sw_poll"))
 		plget->flags |= PLF_SW_POLL;
+
+	if (strstr(optarg, "ipv6"))
+		plget->flags |= PLF_IPV6;
+
+	if (strstr(optarg, "rx_ring"))
+		plget->flags |= PLF_RX_RING;
+
+	if (strstr(optarg, "epoll"))
+		plget->flags |= PLF_EPOLL;
+
+	if (strstr(optarg, "adaptive"))
+		plget->flags |= PLF_ADAPTIVE;
+
+	if (strstr(optarg, "io_uring"))
+		plget->flags |= PLF_URING;
+
+	if (strstr(optarg, "sqpoll"))
+		plget->flags |= PLF_URING | PLF_SQPOLL;
+
+	if (strstr(optarg, "streams"))
+		plget->flags |= PLF_STREAMS;
+
+	if (strstr(optarg, "rx_cpu"))
+		plget->flags |= PLF_RX_CPU;
+
+	if (strstr(optarg, "crc"))
+		plget->flags |= PLF_CRC;
+
+	if (strstr(optarg, "capture_tx"))
+		plget->flags |= PLF_CAPTURE_TX;
+
+	if (strstr(optarg, "tx_ts"))
+		plget->flags |= PLF_TX_TS;
+
+	if (strstr(optarg, "coal"))
+		plget->flags |= PLF_COAL;
+
+	if (strstr(optarg, "hist"))
+		plget->flags |= PLF_HIST;
 }
 
 static void plget_set_relative_time(void)
@@ -387,8 +764,7 @@ static void plget_set_relative_time(void)
 	__u64 ns;
 
 	sscanf(optarg, "%llu", &ns);
-	plget->rtime.tv_sec = ns / NSEC_PER_SEC;
-	plget->rtime.tv_nsec = ns - (__u64)plget->rtime.tv_sec * NSEC_PER_SEC;
+	plget->rtime = ns;
 	plget->flags |= PLF_RTIME;
 }
 
@@ -402,6 +778,111 @@ static void plget_set_stream_id(void)
 	plget->stream_id <<= STREAM_ID_SHIFT;
 }
 
+static void plget_set_vlan(void)
+{
+	char *str = optarg, *end;
+	long vid, pcp;
+
+	for (;;) {
+		if (plget->vlan_num == VLAN_MAX_NUM)
+			plget_fail("only two vlan tags are supported");
+
+		vid = strtol(str, &end, 0);
+		if (end == str || vid < 0 || vid > 4095)
+			plget_fail("Invalid vlan id");
+
+		pcp = 0;
+		if (*end == ':') {
+			str = end + 1;
+			pcp = strtol(str, &end, 0);
+			if (end == str || pcp < 0 || pcp > 7)
+				plget_fail("Invalid vlan pcp");
+		}
+
+		plget->vlan_tci[plget->vlan_num++] = pcp << 13 | vid;
+
+		if (*end != ',')
+			break;
+
+		str = end + 1;
+	}
+
+	if (*end != '\0')
+		plget_fail("Invalid vlan");
+}
+
+static void plget_set_batch(void)
+{
+	plget->batch = atoi(optarg);
+
+	if (plget->batch <= 0 || plget->batch > RX_BATCH_MAX)
+		plget_fail("batch has to be in range 1 - 1024");
+}
+
+static void plget_set_fanout(void)
+{
+	char *num;
+
+	num = strchr(optarg, ':');
+	if (num)
+		*num++ = '\0';
+
+	if (!strcmp(optarg, "hash"))
+		plget->fanout_mode = PACKET_FANOUT_HASH;
+	else if (!strcmp(optarg, "cpu"))
+		plget->fanout_mode = PACKET_FANOUT_CPU;
+	else if (!strcmp(optarg, "qm"))
+		plget->fanout_mode = PACKET_FANOUT_QM;
+	else
+		plget_fail("Unknown fanout mode");
+
+	plget->fanout_num = num ? atoi(num) : sysconf(_SC_NPROCESSORS_ONLN);
+	if (plget->fanout_num <= 0)
+		plget_fail("Invalid number of fanout workers");
+
+	plget->flags |= PLF_FANOUT;
+}
+
+static void plget_set_capture(void)
+{
+	char *len;
+
+	len = strchr(optarg, ':');
+	if (len)
+		*len++ = '\0';
+
+	plget->capture = optarg;
+	plget->snaplen = len ? atoi(len) : PCAP_SNAPLEN;
+	if (plget->snaplen <= 0 || plget->snaplen > PCAP_SNAPLEN)
+		plget_fail("Invalid capture length");
+
+	plget->flags |= PLF_CAPTURE;
+}
+
+static void plget_set_coal_sweep(void)
+{
+	char *usecs;
+
+	for (usecs = strtok(optarg, ","); usecs; usecs = strtok(NULL, ",")) {
+		if (plget->coal_num == COAL_SWEEP_MAX)
+			plget_fail("too many rx-usecs to sweep");
+
+		plget->coal_usecs[plget->coal_num++] = atoi(usecs);
+	}
+
+	plget->flags |= PLF_COAL;
+}
+
+static void plget_set_hist_digits(void)
+{
+	int digits = atoi(optarg);
+
+	if (digits < 1 || digits > STATS_HIST_DIGITS_MAX)
+		plget_fail("Invalid number of histogram digits");
+
+	plget->hist_bits = stats_hist_bits(digits);
+}
+
 static void plget_set_pkt_num(void)
 {
 	plget->pkt_num = atoi(optarg);
@@ -414,7 +895,10 @@ static void read_args(int argc, char **argv)
 {
 	int idx, opt;
 
-	while ((opt = getopt_long(argc, argv, "s:u:p:i:m:n:l:a:t:f:b:cw:r:k:d:q:zho:",
+	plget->idle_timeout = RX_IDLE_TIMEOUT;
+	plget->seed = 1;
+	plget->hist_bits = stats_hist_bits(STATS_HIST_DIGITS);
+	while ((opt = getopt_long(argc, argv, "s:u:p:i:m:n:l:a:A:t:f:b:F:C:W:H:cw:B:S:T:r:k:P:d:q:v:zho:",
 	       plget_options, &idx)) != -1) {
 		switch (opt) {
 		case 's':
@@ -443,6 +927,9 @@ static void read_args(int argc, char **argv)
 		case 'a':
 			plget_set_address();
 			break;
+		case 'A':
+			plget_set_ip_address();
+			break;
 		case 'c':
 			plget->flags |= PLF_TITLE;
 			break;
@@ -457,18 +944,52 @@ static void read_args(int argc, char **argv)
 			plget->busypoll_time = atoi(optarg);
 			plget->flags |= PLF_BUSYPOLL;
 			break;
+		case 'B':
+			plget->busypoll_budget = atoi(optarg);
+			plget->flags |= PLF_EPOLL;
+			break;
+		case 'S':
+			plget->spin_time = atoi(optarg) * 1000ULL;
+			plget->flags |= PLF_ADAPTIVE;
+			break;
+		case 'T':
+			plget->idle_timeout = atoi(optarg);
+			if (plget->idle_timeout < 0)
+				plget_fail("Invalid idle timeout");
+			break;
 		case 'r':
 			plget_set_relative_time();
 			break;
 		case 'k':
 			plget_set_stream_id();
 			break;
+		case 'P':
+			plget->seed = strtoul(optarg, NULL, 0);
+			break;
 		case 'd':
 			plget->dev_deep = atoi(optarg);
 			break;
 		case 'q':
 			plget->queue = atoi(optarg);
 			break;
+		case 'v':
+			plget_set_vlan();
+			break;
+		case 'b':
+			plget_set_batch();
+			break;
+		case 'F':
+			plget_set_fanout();
+			break;
+		case 'C':
+			plget_set_capture();
+			break;
+		case 'W':
+			plget_set_coal_sweep();
+			break;
+		case 'H':
+			plget_set_hist_digits();
+			break;
 		case 'z':
 			plget->flags |= PLF_ZERO_COPY;
 			break;
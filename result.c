@@ -13,17 +13,23 @@
  */
 
 #include "plget_args.h"
+#include "coal.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/ioctl.h>
+#include <arpa/inet.h>
 #include <linux/sockios.h>
 #include <linux/ethtool.h>
 
 #define MEASUREMENTS_NUM		5
 #define NSEC_PER_USEC			1000ULL
 
+/* hw time, gap, three rx latencies, one-way and end-to-end ones */
+#define RES_RX_STAGE_MAX		7
+
 static void res_print_clock_info(int clock, char *clock_name)
 {
 	struct timespec res[MEASUREMENTS_NUM];
@@ -92,62 +98,57 @@ static void res_print_clock_info(int clock, char *clock_name)
 	printf("\n");
 }
 
+/* every stage of tx latency is put to own buffer, all are reduced at once */
 static int res_tx_lat_print(void)
 {
-	struct timespec *rtime;
+	struct stats_stage *st;
+	int i, num = 0, n = 0;
+	__u64 *rtime;
 	int print_flags;
 	struct stats *v;
-	int n = 0;
 
 	print_flags = plget->flags & PLF_PLAIN_FORMAT ? STATS_PLAIN_OUTPUT : 0;
 
+	/* three latencies, dev_deep + 2 of scheds, hw time and gap */
+	st = calloc(plget->dev_deep + 7, sizeof(*st));
+	if (!st)
+		return perror("Cannot allocate tx latency stages"), 0;
+
 	if (plget->flags & PLF_LATENCY_STAT) {
-		stats_diff(&tx_hw_v, &tx_sw_v, &temp);
-		n |= stats_print("\ndma + NIC tx latency, us (not complete "
-				 "driver latency, driver s/w ts -> wire)" ,
-				 &temp, print_flags, NULL);
-
-		stats_diff(&tx_sw_v, &tx_app_v, &temp);
-		n |= stats_print("\nstack + packet scheduler + part of "
-				 "driver tx latency, us (app -> some place in the "
-				 "NIC driver, app -> driver s/w ts)",
-				  &temp, print_flags, NULL);
-
-		stats_diff(&tx_hw_v, &tx_app_v, &temp);
-		n |= stats_print("\ncomplete tx latency, us (driver latency + "
-				 "stack latency, app -> wire)",
-				  &temp, print_flags, NULL);
+		stats_stage(&st[num++], "\ndma + NIC tx latency, us (not "
+			    "complete driver latency, driver s/w ts -> wire)",
+			    &tx_hw_v, &tx_sw_v, print_flags, NULL);
+		stats_stage(&st[num++], "\nstack + packet scheduler + part of "
+			    "driver tx latency, us (app -> some place in the "
+			    "NIC driver, app -> driver s/w ts)",
+			    &tx_sw_v, &tx_app_v, print_flags, NULL);
+		stats_stage(&st[num++], "\ncomplete tx latency, us (driver "
+			    "latency + stack latency, app -> wire)",
+			    &tx_hw_v, &tx_app_v, print_flags, NULL);
 	}
 
 	if (plget->flags & PLF_SCHED_STAT) {
-		struct stats *v;
-		int i;
-
 		v = tx_sch_v;
-		stats_diff(v, &tx_app_v, &temp);
-		n |= stats_print("\nstack tx latency, us (based on s/w "
-				 "timestamps, app -> packet scheduler)",
-				  &temp, print_flags, NULL);
+		stats_stage(&st[num++], "\nstack tx latency, us (based on s/w "
+			    "timestamps, app -> packet scheduler)",
+			    v, &tx_app_v, print_flags, NULL);
 
 		for (i = 1; i < plget->dev_deep; i++) {
-			printf("psched%d -> psched%d\n", i, i + 1);
-			stats_diff(&tx_sch_v[i], v, &temp);
-			n |= stats_print("\nbetween device (sched) tx latency, "
-					 "us (based on s/w timestamps, psched "
-					 "-> psched)",
-					 &temp, print_flags, NULL);
+			stats_stage(&st[num], "\nbetween device (sched) tx "
+				    "latency, us (based on s/w timestamps, "
+				    "psched -> psched)",
+				    &tx_sch_v[i], v, print_flags, NULL);
+			snprintf(st[num++].hdr, sizeof(st->hdr),
+				 "psched%d -> psched%d\n", i, i + 1);
 			v = &tx_sch_v[i];
 		}
 
-		stats_diff(&tx_sw_v, v, &temp);
-		n |= stats_print("\npacket scheduler + part of driver tx "
-				 "latency, us (packet scheduler -> driver s/w "
-				 "ts)", &temp, print_flags, NULL);
-
-		stats_diff(&tx_hw_v, v, &temp);
-		n |= stats_print("\ndriver + packet scheduler tx latency, "
-				 "us (packet scheduler entrance -> wire)",
-				  &temp, print_flags, NULL);
+		stats_stage(&st[num++], "\npacket scheduler + part of driver "
+			    "tx latency, us (packet scheduler -> driver s/w "
+			    "ts)", &tx_sw_v, v, print_flags, NULL);
+		stats_stage(&st[num++], "\ndriver + packet scheduler tx "
+			    "latency, us (packet scheduler entrance -> wire)",
+			    &tx_hw_v, v, print_flags, NULL);
 	}
 
 	if (plget->flags & PLF_HW_STAT) {
@@ -158,25 +159,88 @@ static int res_tx_lat_print(void)
 							 tx_hw_v.start_ts;
 		}
 
-		n |= stats_print("\nhw tx time, us", &tx_hw_v, print_flags,
-				 rtime);
+		stats_stage(&st[num++], "\nhw tx time, us", &tx_hw_v, NULL,
+			    print_flags, rtime);
 	}
 
 	if (plget->flags & PLF_IPGAP_STAT) {
 		v = (plget->flags & PLF_DIS_HW_TS) ? &rx_sw_v : &rx_hw_v;
-		n |= stats_print("\ngap of hw tx time, us", v,
-				  print_flags | STATS_GAP_DATA, NULL);
+		stats_stage(&st[num++], "\ngap of hw tx time, us", v, NULL,
+			    print_flags | STATS_GAP_DATA, NULL);
 	}
 
+	stats_stages_run(st, num);
+	for (i = 0; i < num; i++)
+		n |= stats_stage_print(&st[i]);
+
+	free(st);
+	return n;
+}
+
+static unsigned long res_rx_seq_recv(struct rx_seq *seq, int num)
+{
+	unsigned long recv = 0;
+	int id;
+
+	for (id = 0; id < num; id++)
+		recv += seq->seen[id];
+
+	return recv;
+}
+
+/* loss and reordering of rx-lat packets by id, num is size of id space */
+static void res_rx_seq_print(struct rx_seq *seq, int num)
+{
+	unsigned long lost;
+
+	lost = num - res_rx_seq_recv(seq, num);
+	printf("\nlost packets: %lu of %d (%.3f%%)", lost, num,
+	       100.0 * lost / num);
+	if (plget->rx_idle)
+		printf(", ended by idle timeout %dms", plget->idle_timeout);
+
+	printf("\nreordered packets: %lu, max distance %u, late (more than "
+	       "%d): %lu\n", seq->reorder, seq->reorder_max, RX_LATE_DIST,
+	       seq->late);
+	printf("duplicated packets: %lu, invalid id: %lu\n", seq->dup,
+	       seq->invalid);
+	if (plget->flags & PLF_CRC && !plget->rx_streams)
+		printf("corrupted packets: %lu\n", seq->corrupt);
+}
+
+/* latencies counted in histograms as packets came, see -o hist */
+static int res_rx_hist_print(void)
+{
+	int n = 0;
+
+	n |= stats_hist_print("\ndriver rx latency, us (no stack latency, "
+			      "wire -> net subsystem)",
+			      &rx_lat_h[RX_STAGE_DRV]);
+	n |= stats_hist_print("\nstack rx latency, us (no driver latency,  "
+			      "net subsystem -> app)",
+			      &rx_lat_h[RX_STAGE_STACK]);
+	n |= stats_hist_print("\ncomplete rx latency, us (driver latency + "
+			      "stack latency, wire -> app)",
+			      &rx_lat_h[RX_STAGE_ALL]);
+	n |= stats_hist_print("\none-way latency, us (sender app -> wire, "
+			      "or net subsystem w/o h/w ts)",
+			      &rx_lat_h[RX_STAGE_OW]);
+	n |= stats_hist_print("\nend-to-end latency, us (sender app -> app)",
+			      &rx_lat_h[RX_STAGE_E2E]);
 	return n;
 }
 
+/* every stage of rx latency is put to own buffer, all are reduced at once */
 static int res_rx_lat_print(void)
 {
-	struct timespec *rtime;
+	struct stats_stage st[RES_RX_STAGE_MAX];
+	int i, coal, num = 0, n = 0;
+	__u64 *rtime;
 	int print_flags;
 	struct stats *v;
-	int n = 0;
+
+	if (plget->flags & PLF_HIST)
+		return res_rx_hist_print();
 
 	print_flags = plget->flags & PLF_PLAIN_FORMAT ? STATS_PLAIN_OUTPUT : 0;
 
@@ -187,46 +251,67 @@ static int res_rx_lat_print(void)
 			rtime = plget->mod == RTT_MOD ? tx_hw_v.start_ts :
 							rx_hw_v.start_ts;
 
-		n |= stats_print("\nhw rx time, us", &rx_hw_v, print_flags,
-				 rtime);
+		stats_stage(&st[num++], "\nhw rx time, us", &rx_hw_v, NULL,
+			    print_flags, rtime);
 	}
 
 	if (plget->flags & PLF_IPGAP_STAT) {
 		v = (plget->flags & PLF_DIS_HW_TS) ? &rx_sw_v : &rx_hw_v;
-		n |= stats_print("\ngap of sw rx time, us", v,
-				 print_flags | STATS_GAP_DATA, NULL);
+		stats_stage(&st[num++], "\ngap of sw rx time, us", v, NULL,
+			    print_flags | STATS_GAP_DATA, NULL);
 	}
 
 	if (plget->flags & PLF_LATENCY_STAT) {
-		stats_diff(&rx_sw_v, &rx_hw_v, &temp);
-		n |= stats_print("\ndriver rx latency, us (no stack latency, "
-				 "wire -> net subsystem)",
-				 &temp, print_flags, NULL);
-		stats_diff(&rx_app_v, &rx_sw_v, &temp);
-		n |= stats_print("\nstack rx latency, us (no driver latency,  "
-				 "net subsystem -> app)",
-				 &temp, print_flags, NULL);
-		stats_diff(&rx_app_v, &rx_hw_v, &temp);
-		n |= stats_print("\ncomplete rx latency, us (driver latency + "
-				 "stack latency, wire -> app)",
-				 &temp, print_flags, NULL);
+		stats_stage(&st[num++], "\ndriver rx latency, us (no stack "
+			    "latency, wire -> net subsystem)",
+			    &rx_sw_v, &rx_hw_v, print_flags, NULL);
+		stats_stage(&st[num++], "\nstack rx latency, us (no driver "
+			    "latency,  net subsystem -> app)",
+			    &rx_app_v, &rx_sw_v, print_flags, NULL);
+		stats_stage(&st[num++], "\ncomplete rx latency, us (driver "
+			    "latency + stack latency, wire -> app)",
+			    &rx_app_v, &rx_hw_v, print_flags, NULL);
+	}
+
+	/* coalescing report goes between rx latencies and one-way ones */
+	coal = num;
+
+	/* hosts have to be synchronized, sender ts is its app time */
+	if (plget->flags & PLF_LATENCY_STAT && rx_snd_v.start_ts) {
+		v = stats_correct_id(&rx_hw_v, 0) ? &rx_hw_v : &rx_sw_v;
+		stats_stage(&st[num++], "\none-way latency, us (sender app -> "
+			    "wire, or net subsystem w/o h/w ts)",
+			    v, &rx_snd_v, print_flags, NULL);
+		stats_stage(&st[num++], "\nend-to-end latency, us (sender app "
+			    "-> app)", &rx_app_v, &rx_snd_v, print_flags, NULL);
 	}
 
+	stats_stages_run(st, num);
+	for (i = 0; i < coal; i++)
+		n |= stats_stage_print(&st[i]);
+
+	if (plget->flags & PLF_COAL)
+		coal_print(&rx_sw_v, &rx_hw_v);
+
+	for (; i < num; i++)
+		n |= stats_stage_print(&st[i]);
+
 	return n;
 }
 
 static void res_rtt_print(void)
 {
 	struct stats *a_stat, *b_stat;
+	struct stats_stage st;
 	char *a_ts_base, *b_ts_base;
 	int print_flags;
 
 	print_flags = plget->flags & PLF_PLAIN_FORMAT ? STATS_PLAIN_OUTPUT : 0;
 
-	if (ts_correct(tx_hw_v.start_ts)) {
+	if (stats_correct_id(&tx_hw_v, 0)) {
 		a_stat = &tx_hw_v;
 		a_ts_base = "hw";
-	} else if (ts_correct(tx_sw_v.start_ts)) {
+	} else if (stats_correct_id(&tx_sw_v, 0)) {
 		a_stat = &tx_sw_v;
 		a_ts_base = "sw";
 	} else {
@@ -234,10 +319,10 @@ static void res_rtt_print(void)
 		a_ts_base = "app";
 	}
 
-	if (ts_correct(rx_hw_v.start_ts)) {
+	if (stats_correct_id(&rx_hw_v, 0)) {
 		b_stat = &rx_hw_v;
 		b_ts_base = "hw";
-	} else if (ts_correct(rx_sw_v.start_ts)) {
+	} else if (stats_correct_id(&rx_sw_v, 0)) {
 		b_stat = &rx_sw_v;
 		b_ts_base = "sw";
 	} else {
@@ -248,16 +333,17 @@ static void res_rtt_print(void)
 	printf("RTT (round trip time) for this HOST based on "
 		"tx %s and rx %s timestamps\n", a_ts_base, b_ts_base);
 
-	stats_diff(b_stat, a_stat, &temp);
-	stats_print("\nRTT (no rx/tx latencies of this HOST, us",
-		    &temp, print_flags, NULL);
+	stats_stage(&st, "\nRTT (no rx/tx latencies of this HOST, us",
+		    b_stat, a_stat, print_flags, NULL);
+	stats_stages_run(&st, 1);
+	stats_stage_print(&st);
 }
 
 static struct stats *res_best_rx_vect(void)
 {
-	if (ts_correct(rx_hw_v.start_ts))
+	if (stats_correct_id(&rx_hw_v, 0))
 		return &rx_hw_v;
-	else if (ts_correct(rx_sw_v.start_ts))
+	else if (stats_correct_id(&rx_sw_v, 0))
 		return &rx_sw_v;
 	else
 		return &rx_app_v;
@@ -265,14 +351,81 @@ static struct stats *res_best_rx_vect(void)
 
 static struct stats *res_best_tx_vect(void)
 {
-	if (ts_correct(tx_hw_v.start_ts))
+	if (stats_correct_id(&tx_hw_v, 0))
 		return &tx_hw_v;
-	else if (ts_correct(tx_sw_v.start_ts))
+	else if (stats_correct_id(&tx_sw_v, 0))
 		return &tx_sw_v;
 	else
 		return &tx_app_v;
 }
 
+/*
+ * One line per stream to compare them, latency is complete rx one if h/w
+ * timestamps are present or stack one otherwise, gap is between packets.
+ */
+static void res_rx_streams_summary(void)
+{
+	struct rx_stream *s;
+	unsigned long recv;
+	double lat, gap;
+	struct stats *v;
+	int i;
+
+	printf("\nstream    packets       lost  reordered  latency, us"
+	       "      gap, us\n");
+	for (i = 0; i < STREAM_NUM; i++) {
+		s = &plget->rx_streams[i];
+		if (!s->seq.next_id)
+			continue;
+
+		lat = 0;
+		gap = 0;
+		if (s->app_v.start_ts) {
+			v = stats_correct_id(&s->hw_v, 0) ? &s->hw_v :
+							     &s->sw_v;
+			stats_diff(&s->app_v, v, &temp);
+			lat = stats_avg(&temp, 0);
+			gap = stats_avg(v, STATS_GAP_DATA);
+		}
+
+		recv = res_rx_seq_recv(&s->seq, s->seq.next_id);
+		printf("%6d %10lu %10lu %10lu %12.2f %12.2f\n", i, recv,
+		       s->seq.next_id - recv, s->seq.reorder, lat, gap);
+	}
+}
+
+/* every stream is printed as separate rx-lat test, ids are per stream */
+static int res_rx_streams_print(void)
+{
+	struct rx_stream *s;
+	int i, n = 0;
+
+	for (i = 0; i < STREAM_NUM; i++) {
+		s = &plget->rx_streams[i];
+		if (!s->seq.next_id)
+			continue;
+
+		printf("\n================ stream %d ================\n", i);
+		rx_app_v = s->app_v;
+		rx_sw_v = s->sw_v;
+		rx_hw_v = s->hw_v;
+		rx_snd_v = s->snd_v;
+		n += res_rx_lat_print();
+		res_rx_seq_print(&s->seq, s->seq.next_id);
+		stats_vrate_print(res_best_rx_vect(), plget->frame_size);
+	}
+
+	if (plget->rx_seq.invalid)
+		printf("\npackets of unknown stream: %lu\n",
+		       plget->rx_seq.invalid);
+
+	if (plget->flags & PLF_CRC)
+		printf("\ncorrupted packets: %lu\n", plget->rx_seq.corrupt);
+
+	res_rx_streams_summary();
+	return n;
+}
+
 void res_title_print(void)
 {
 	struct timespec ts1, ts2, res;
@@ -346,6 +499,206 @@ int res_get_intf_speed(void)
 	return ethtool_cmd_speed(&edata);
 }
 
+/* stack latency percentiles, so runs of different rx wait can be compared */
+static void res_rx_wait_pct_print(void)
+{
+	struct stats_hist h, *lat = &rx_lat_h[RX_STAGE_STACK];
+	__u64 *ts;
+
+	if (!(plget->flags & PLF_HIST)) {
+		if (stats_hist_init(&h, plget->hist_bits))
+			return;
+
+		stats_diff(&rx_app_v, &rx_sw_v, &temp);
+		for (ts = temp.start_ts; ts < temp.next_ts; ts++)
+			stats_hist_add(&h, *ts);
+
+		lat = &h;
+	}
+
+	if (lat->num) {
+		printf("rx wait stack latency, ");
+		stats_hist_pct_print(lat);
+	}
+
+	if (lat == &h)
+		stats_hist_free(&h);
+}
+
+/* to compare latencies of irq driven and busy poll receive */
+static void res_rx_wait_print(void)
+{
+	printf("rx wait: ");
+
+	if (plget->flags & PLF_SQPOLL)
+		printf("io_uring with sqpoll, ");
+	else if (plget->flags & PLF_URING)
+		printf("io_uring, ");
+
+	if (plget->flags & PLF_SW_POLL)
+		printf("sw poll");
+	else if (plget->flags & PLF_ADAPTIVE && plget->spin_time)
+		printf("adaptive poll, spin %lluus", plget->spin_time / 1000);
+	else if (plget->flags & PLF_ADAPTIVE)
+		printf("adaptive poll, self tuned spin");
+	else if (plget->busypoll_budget)
+		printf("epoll busy poll %dus, budget %d",
+		       plget->busypoll_time, plget->busypoll_budget);
+	else if (plget->flags & PLF_EPOLL)
+		printf("epoll, irq driven");
+	else
+		printf("blocking syscall, irq driven");
+
+	if (!plget->busypoll_budget && plget->flags & PLF_BUSYPOLL)
+		printf(", socket busy poll %dus", plget->busypoll_time);
+
+	printf("\n");
+	res_rx_wait_pct_print();
+}
+
+/* stack latency of packets caught while spinning or after blocking */
+static void res_rx_group_print(char *name, int group)
+{
+	double val, sum = 0, min_val = 0, max_val = 0;
+	unsigned long n = 0;
+	__u64 *ts;
+	__u32 id;
+
+	stats_diff(&rx_app_v, &rx_sw_v, &temp);
+	for (ts = temp.start_ts; ts < temp.next_ts; ts++) {
+		id = ts - temp.start_ts;
+		if (plget->rx_groups[id] != group)
+			continue;
+
+		val = *ts / 1000.0;
+		if (!n || val < min_val)
+			min_val = val;
+
+		if (!n || val > max_val)
+			max_val = val;
+
+		sum += val;
+		n++;
+	}
+
+	printf("%s: %lu packets", name, n);
+	if (n)
+		printf(", stack rx latency mean = %.2fus, min = %.2fus, "
+		       "max = %.2fus", sum / n, min_val, max_val);
+
+	printf("\n");
+}
+
+/* packets with same rx cpu or napi id */
+struct res_rx_key {
+	__u32 key;
+	unsigned long n;
+	double sum;
+	double min;
+	double max;
+};
+
+static int res_rx_key_cmp(const void *a, const void *b)
+{
+	const struct res_rx_key *ka = a, *kb = b;
+
+	return (ka->key > kb->key) - (ka->key < kb->key);
+}
+
+/* stack latency of packets split by key of every packet, cpu or napi id */
+static void res_rx_keys_print(char *name, __u32 *keys)
+{
+	struct res_rx_key *ks, *k;
+	int i, num = 0;
+	__u64 *ts;
+	double val;
+	__u32 id;
+
+	stats_diff(&rx_app_v, &rx_sw_v, &temp);
+	ks = calloc(temp.next_ts - temp.start_ts + 1, sizeof(*ks));
+	if (!ks)
+		return;
+
+	for (ts = temp.start_ts; ts < temp.next_ts; ts++) {
+		id = ts - temp.start_ts;
+		for (i = 0; i < num && ks[i].key != keys[id]; i++)
+			;
+
+		k = &ks[i];
+		if (i == num) {
+			k->key = keys[id];
+			num++;
+		}
+
+		val = *ts / 1000.0;
+		if (!k->n || val < k->min)
+			k->min = val;
+
+		if (!k->n || val > k->max)
+			k->max = val;
+
+		k->sum += val;
+		k->n++;
+	}
+
+	qsort(ks, num, sizeof(*ks), res_rx_key_cmp);
+	for (i = 0; i < num; i++) {
+		k = &ks[i];
+		if (k->key == (__u32)-1)
+			printf("%s unknown", name);
+		else
+			printf("%s %u", name, k->key);
+
+		printf(": %lu packets, stack rx latency mean = %.2fus, "
+		       "min = %.2fus, max = %.2fus\n", k->n, k->sum / k->n,
+		       k->min, k->max);
+	}
+
+	free(ks);
+}
+
+/* only packets of source the socket is connected to are received */
+static void res_rx_peer_print(void)
+{
+	struct sockaddr_in6 *sin6 = &plget->rx_peer;
+	struct sockaddr_in *sin = (struct sockaddr_in *)sin6;
+	char str[INET6_ADDRSTRLEN];
+
+	if (!plget->rx_connected)
+		return;
+
+	if (sin6->sin6_family == AF_INET6)
+		inet_ntop(AF_INET6, &sin6->sin6_addr, str, sizeof(str));
+	else
+		inet_ntop(AF_INET, &sin->sin_addr, str, sizeof(str));
+
+	printf("rx cpu: socket connected to %s port %u, other sources are "
+	       "dropped\n", str, ntohs(sin6->sin6_port));
+}
+
+/* bad irq affinity or rss is seen as latency differing by cpu or queue */
+static void res_rx_cpu_print(void)
+{
+	res_rx_peer_print();
+	if (!rx_app_v.start_ts || !rx_sw_v.start_ts)
+		return;
+
+	res_rx_keys_print("rx cpu", plget->rx_cpus);
+	res_rx_keys_print("napi id", plget->rx_napis);
+}
+
+static void res_rx_adaptive_print(void)
+{
+	printf("adaptive poll: %lu packets while spinning, %lu after "
+	       "blocking\n", plget->spin_cnt, plget->block_cnt);
+
+	if (!rx_app_v.start_ts || !rx_sw_v.start_ts)
+		return;
+
+	res_rx_group_print("spin", RX_GROUP_SPIN);
+	res_rx_group_print("block", RX_GROUP_BLOCK);
+}
+
 void res_stats_print(void)
 {
 	unsigned long long int ftt;
@@ -357,12 +710,30 @@ void res_stats_print(void)
 	int header_size;
 	int pnum, speed;
 
+	if (mod == RX_LAT || mod == ECHO_LAT) {
+		header_size = (plget->pkt_type == PKT_RAW ||
+			       plget->pkt_type == PKT_XDP) ? 0 : ETH_HLEN;
+
+		if (plget->pkt_type == PKT_UDP)
+			header_size += ip_udp_hlen();
+
+		plget->frame_size = header_size + plget->sk_payload_size;
+	}
+
 	printf("\n");
 	if (print_tx_lat)
 		n2 = res_tx_lat_print();
 
-	if (print_rx_lat)
+	if (print_rx_lat && plget->rx_streams) {
+		n = res_rx_streams_print();
+	} else if (print_rx_lat) {
 		n = res_rx_lat_print();
+		if (plget->rx_seq.seen)
+			res_rx_seq_print(&plget->rx_seq, plget->pkt_num);
+		else if (plget->flags & PLF_CRC)
+			printf("corrupted packets: %lu\n",
+			       plget->rx_seq.corrupt);
+	}
 
 	if (mod == ECHO_LAT || mod == RTT_MOD) {
 		if (n != n2)
@@ -378,16 +749,6 @@ void res_stats_print(void)
 		pnum = n | n2;
 	}
 
-	if (mod == RX_LAT || mod == ECHO_LAT) {
-		header_size = (plget->pkt_type == PKT_RAW ||
-			       plget->pkt_type == PKT_XDP) ? 0 : ETH_HLEN;
-
-		if (plget->pkt_type == PKT_UDP)
-			header_size += 28;
-
-		plget->frame_size = header_size + plget->sk_payload_size;
-	}
-
 	if (plget->frame_size) {
 		speed = res_get_intf_speed();
 		printf("Interface speed returned: %dMbps\n", speed);
@@ -401,11 +762,23 @@ void res_stats_print(void)
 
 	printf("number of packets: %d\n", pnum);
 
+	if (print_rx_lat)
+		res_rx_wait_print();
+
+	if (print_rx_lat && plget->flags & PLF_ADAPTIVE)
+		res_rx_adaptive_print();
+
+	if (print_rx_lat && plget->rx_cpus)
+		res_rx_cpu_print();
+
 	if (mod == TX_LAT || mod == RTT_MOD)
 		stats_vrate_print(res_best_tx_vect(), plget->frame_size);
 
-	if (mod == RX_LAT || mod == ECHO_LAT)
+	/* rate of every stream is printed along with its stats */
+	if ((mod == RX_LAT && !plget->rx_streams) || mod == ECHO_LAT)
 		stats_vrate_print(res_best_rx_vect(), plget->frame_size);
 
 	printf("\n");
+	if (plget->coal_num)
+		coal_sweep_print();
 }
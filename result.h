@@ -18,5 +18,6 @@
 void res_title_print(void);
 void res_stats_print(void);
 void res_print_time(void);
+int res_get_intf_speed(void);
 
 #endif
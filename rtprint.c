@@ -21,6 +21,7 @@ void *rtprint(void *arg)
 {
 	unsigned long cnt, num;
 
+	plget = arg;
 	for (;;) {
 		cnt = plget->icnt;
 		num = plget->inum;
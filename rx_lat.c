@@ -12,6 +12,7 @@
  * GNU General Public License for more details.
  */
 
+#define _GNU_SOURCE
 #include <linux/net_tstamp.h>
 #include <time.h>
 #include <linux/errqueue.h>
@@ -24,206 +25,1626 @@
 #include <errno.h>
 #include <poll.h>
 #include "xdp_sock.h"
+#include "rx_ring.h"
+#include "uring.h"
+#include "pkt_parse.h"
+#include "pcap.h"
+#include "result.h"
 #include <string.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <netinet/ip6.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <signal.h>
 
 #define RATE_INERVAL			1
 
-static void rxlat_handle_ts(struct timespec *ts, __u32 ts_id)
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id		_sigev_un._tid
+#endif
+
+/* back-to-back gap if link speed is unknown */
+#define RXRATE_BURST_NS			1000
+/* RFC 3550 jitter estimate gain */
+#define RXRATE_JITTER_DIV		16
+
+static inline int rxlat_more(void)
+{
+	return plget->icnt < plget->pkt_num && !plget->rx_idle;
+}
+
+static struct scm_timestamping *rxlat_get_tss(struct msghdr *msg)
+{
+	struct cmsghdr *cmsg;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+			cmsg->cmsg_type != SCM_TIMESTAMPING)
+			continue;
+
+		return (struct scm_timestamping *) CMSG_DATA(cmsg);
+	}
+
+	fprintf(stderr, "SCM_TIMESTAMPING not found!\n");
+	return NULL;
+}
+
+int rxlat_hist_init(void)
+{
+	int i;
+
+	for (i = 0; i < RX_STAGE_NUM; i++)
+		if (stats_hist_init(&rx_lat_h[i], plget->hist_bits))
+			return -ENOMEM;
+
+	return 0;
+}
+
+/* negative latency of not synced clocks can't be counted */
+static void rxlat_hist_add(int stage, __u64 from, __u64 to)
+{
+	if (from && to >= from)
+		stats_hist_add(&rx_lat_h[stage], to - from);
+}
+
+/* count latencies of packet at once, nothing is stored per packet */
+static void rxlat_hist_push(__u64 app, __u64 sw, __u64 hw, __u64 snd)
+{
+	rxlat_hist_add(RX_STAGE_DRV, hw, sw);
+	rxlat_hist_add(RX_STAGE_STACK, sw, app);
+	rxlat_hist_add(RX_STAGE_ALL, hw, app);
+
+	if (!(plget->flags & PLF_TX_TS))
+		return;
+
+	rxlat_hist_add(RX_STAGE_OW, snd, hw ? hw : sw);
+	rxlat_hist_add(RX_STAGE_E2E, snd, app);
+}
+
+/* store ns timestamps to vectors of packet stream, if streams are demuxed */
+static void rxlat_push_ts(__u64 app, __u64 sw, __u64 hw, __u32 ts_id)
+{
+	struct rx_stream *s = plget->rx_strm;
+	__u64 snd = 0;
+
+	if (plget->flags & PLF_CAPTURE)
+		pcap_rx(plget->rx_pkt, plget->rx_len, app, sw, hw, ts_id);
+
+	if (plget->flags & PLF_TX_TS)
+		snd = tx_ts_rx_rd();
+
+	if (plget->flags & PLF_HIST) {
+		rxlat_hist_push(app, sw, hw, snd);
+		return;
+	}
+
+	if (!s) {
+		stats_push_ns_id(&rx_sw_v, sw, ts_id);
+		stats_push_ns_id(&rx_hw_v, hw, ts_id);
+		stats_push_ns_id(&rx_app_v, app, ts_id);
+		if (plget->flags & PLF_TX_TS)
+			stats_push_ns_id(&rx_snd_v, snd, ts_id);
+		return;
+	}
+
+	stats_push_ns_id(&s->sw_v, sw, ts_id);
+	stats_push_ns_id(&s->hw_v, hw, ts_id);
+	stats_push_ns_id(&s->app_v, app, ts_id);
+	if (plget->flags & PLF_TX_TS)
+		stats_push_ns_id(&s->snd_v, snd, ts_id);
+}
+
+/* af_xdp metadata is in ns already, kernel timespecs are converted here */
+static void rxlat_handle_ts(struct msghdr *msg, struct timespec *ts,
+			    __u32 ts_id)
+{
+	struct scm_timestamping *tss;
+	__u64 sw, hw;
+
+	if (plget->pkt_type == PKT_XDP) {
+		xsk_recvmsg_ts(&sw, &hw);
+		rxlat_push_ts(ts_ns(ts), sw, hw, ts_id);
+		return;
+	}
+
+	tss = rxlat_get_tss(msg);
+	if (!tss)
+		return;
+
+	rxlat_push_ts(ts_ns(ts), ts_ns(tss->ts), ts_ns(tss->ts + 2), ts_id);
+}
+
+/* wait for ingress packets, busy polls NAPI if prefer busy poll is set */
+static int rxlat_epoll_wait(void)
+{
+	struct epoll_event ev;
+	int ret;
+
+	ret = epoll_wait(plget->epfd, &ev, 1, -1);
+	if (ret < 0 && errno != EINTR)
+		perror("epoll_wait");
+
+	return ret;
+}
+
+static inline int rxlat_use_epoll(void)
+{
+	return (plget->flags & (PLF_EPOLL | PLF_SW_POLL)) == PLF_EPOLL;
+}
+
+static int rxlat_block_recvmsg(void)
+{
+	int psize;
+
+	if (!(plget->flags & PLF_EPOLL))
+		return recvmsg(plget->sfd, &plget->msg, 0);
+
+	do {
+		if (rxlat_epoll_wait() < 0)
+			return -1;
+
+		psize = recvmsg(plget->sfd, &plget->msg, MSG_DONTWAIT);
+	} while (psize < 0 && errno == EAGAIN);
+
+	return psize;
+}
+
+/* spin time twice of usual wait, or minimal if packets are rare */
+static void rxlat_tune_spin(__u64 wait)
+{
+	__u64 budget;
+
+	plget->wait_avg += ((__s64)wait - (__s64)plget->wait_avg) / 8;
+
+	budget = plget->wait_avg * 2;
+	if (budget > SPIN_MAX_NS || budget < SPIN_MIN_NS)
+		budget = SPIN_MIN_NS;
+
+	plget->spin_budget = budget;
+}
+
+/* spin on non blocking recvmsg for spin budget and block then */
+static int rxlat_adaptive_recvmsg(void)
+{
+	struct timespec start, now, diff;
+	__u64 wait;
+	int psize;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (;;) {
+		psize = recvmsg(plget->sfd, &plget->msg, MSG_DONTWAIT);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		ts_sub(&now, &start, &diff);
+		wait = diff.tv_sec * NSEC_PER_SEC + diff.tv_nsec;
+
+		if (psize >= 0 || errno != EAGAIN) {
+			plget->rx_group = RX_GROUP_SPIN;
+			break;
+		}
+
+		if (wait < plget->spin_budget)
+			continue;
+
+		psize = rxlat_block_recvmsg();
+		if (psize < 0)
+			return psize;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		ts_sub(&now, &start, &diff);
+		wait = diff.tv_sec * NSEC_PER_SEC + diff.tv_nsec;
+
+		plget->rx_group = RX_GROUP_BLOCK;
+		break;
+	}
+
+	if (!plget->spin_time)
+		rxlat_tune_spin(wait);
+
+	return psize;
+}
+
+static int rxlat_recvmsg_start(struct timespec *ts)
+{
+	int flags, psize;
+
+	if (plget->pkt_type == PKT_XDP) {
+		psize = xsk_recvmsg_start(ts);
+		return psize;
+	}
+
+	if (plget->flags & PLF_ADAPTIVE) {
+		psize = rxlat_adaptive_recvmsg();
+	} else if (rxlat_use_epoll()) {
+		psize = rxlat_block_recvmsg();
+	} else {
+		flags = (plget->flags & PLF_SW_POLL) ? MSG_DONTWAIT : 0;
+		do
+			psize = recvmsg(plget->sfd, &plget->msg, flags);
+		while (psize <= 0 && flags && !plget->rx_idle);
+	}
+
+	if (clock_gettime(CLOCK_REALTIME, ts))
+		return -1;
+
+	return psize;
+}
+
+/*
+ * Raw frame is ours if it's udp to our port or PTP, behind any vlan tags or
+ * tunnel headers. Locates magic in it for rx helpers.
+ */
+static int rxlat_raw_pkt(int psize)
+{
+	struct pkt_hdrs hdrs;
+	int ok_pkt;
+
+	if (parse_pkt(plget->rx_pkt, psize, &hdrs))
+		return 0;
+
+	if (plget->flags & PLF_RAW_UDP)
+		ok_pkt = hdrs.l4_proto == IPPROTO_UDP &&
+			 hdrs.dport == plget->port;
+	else
+		ok_pkt = (plget->flags & PLF_PTP) && hdrs.proto == ETH_P_1588;
+
+	plget->rx_off = hdrs.off + plget->off_magic_pl;
+	plget->rx_l3_off = hdrs.l3_off;
+	plget->rx_l4_off = hdrs.l4_off;
+
+	return ok_pkt && plget->rx_off + PL_HLEN <= psize;
+}
+
+static int rxlat_recvmsg_raw_filter(int psize)
+{
+	if (plget->pkt_type != PKT_XDP && plget->pkt_type != PKT_RAW)
+		return 0;
+
+	/* drop not expected packets */
+	if (!rxlat_raw_pkt(psize)) {
+		if (plget->pkt_type == PKT_XDP)
+			xsk_recvmsg_fail();
+
+		return -1;
+	}
+
+	if (plget->pkt_type == PKT_XDP)
+		xsk_recvmsg_complete();
+
+	return 0;
+}
+
+/* crc32c in last 4 bytes covers payload from PTP header or magic */
+static int rxlat_crc_ok(int psize)
+{
+	int off = plget->rx_off - plget->off_magic_pl;
+	__u32 crc;
+
+	if (psize < plget->rx_off + PL_HLEN + CRC_LEN)
+		return 0;
+
+	memcpy(&crc, plget->rx_pkt + psize - CRC_LEN, sizeof(crc));
+	return ntohl(crc) == crc32c(plget->rx_pkt + off,
+				    psize - CRC_LEN - off);
+}
+
+/* check packet in plget->rx_pkt, returns 0 if it's one of ours */
+static int rxlat_check_pkt(int psize, __u32 *ts_id)
+{
+	char *magic;
+	int sid;
+
+	if (rxlat_recvmsg_raw_filter(psize))
+		return -1;
+
+	plget->rx_len = psize;
+
+	/* corrupted packet can't be trusted to have right id or stream */
+	if (plget->flags & PLF_CRC && !rxlat_crc_ok(psize)) {
+		plget->rx_seq.corrupt++;
+		return -1;
+	}
+
+	/* check magic number */
+	magic = magic_rx_rd();
+	if (*magic != MAGIC) {
+		printf("incorrect rx MAGIC number 0x%x\n", *magic);
+		return -1;
+	}
+
+	*ts_id = tid_rx_rd();
+	if (plget->rx_rebase) {
+		plget->rx_id_base = *ts_id;
+		plget->rx_rebase = 0;
+	}
+
+	*ts_id -= plget->rx_id_base;
+	if (!plget->rx_streams)
+		return 0;
+
+	sid = sid_rx_rd();
+	if (sid >= STREAM_NUM) {
+		plget->rx_seq.invalid++;
+		return -1;
+	}
+
+	plget->rx_strm = &plget->rx_streams[sid];
+	return 0;
+}
+
+/*
+ * Account packet by id in sequence of its stream, returns 0 if it's new one.
+ * Packet is reordered if it comes after one with higher id, distance is
+ * difference of their ids.
+ */
+static int rxlat_seq(__u32 ts_id)
+{
+	struct rx_seq *seq;
+	__u32 dist;
+
+	seq = plget->rx_strm ? &plget->rx_strm->seq : &plget->rx_seq;
+	if (ts_id >= plget->pkt_num) {
+		seq->invalid++;
+		return -1;
+	}
+
+	if (!seq->seen)
+		return 0;
+
+	if (seq->seen[ts_id]) {
+		seq->dup++;
+		return -1;
+	}
+
+	seq->seen[ts_id] = 1;
+	if (ts_id >= seq->next_id) {
+		seq->next_id = ts_id + 1;
+		return 0;
+	}
+
+	dist = seq->next_id - 1 - ts_id;
+	if (dist > seq->reorder_max)
+		seq->reorder_max = dist;
+
+	if (dist > RX_LATE_DIST)
+		seq->late++;
+
+	seq->reorder++;
+	return 0;
+}
+
+static int rxlat_recvmsg(struct timespec *ts, __u32 *ts_id)
+{
+	int psize;
+
+	for (;;) {
+		psize = rxlat_recvmsg_start(ts);
+		if (psize < 0)
+			return psize;
+
+		if (!rxlat_check_pkt(psize, ts_id))
+			break;
+	}
+
+	return psize;
+}
+
+/*
+ * Socket keeps cpu and napi id of last packet queued to it, so they are
+ * of this packet unless next one is queued already. Udp socket updates
+ * them for every packet only if it's connected, so it's connected to
+ * source of first packet, cpu of which stays unknown.
+ */
+static void rxlat_get_cpu(__u32 ts_id)
+{
+	socklen_t len;
+	int val;
+
+	val = -1;
+	len = sizeof(val);
+	getsockopt(plget->sfd, SOL_SOCKET, SO_INCOMING_CPU, &val, &len);
+	plget->rx_cpus[ts_id] = val;
+
+	val = 0;
+	len = sizeof(val);
+	getsockopt(plget->sfd, SOL_SOCKET, SO_INCOMING_NAPI_ID, &val, &len);
+	plget->rx_napis[ts_id] = val;
+
+	if (plget->rx_connected)
+		return;
+
+	plget->rx_connected = 1;
+	if (connect(plget->sfd, plget->msg.msg_name, plget->msg.msg_namelen))
+		perror("Couldn't connect to packet source");
+}
+
+/*
+ * Returns 0 if packet is received and stored, 1 if it's skipped or wait is
+ * interrupted by idle timer.
+ */
+static int rxlat_recv_packet(void)
+{
+	struct timespec ts;
+	__u32 ts_id;
+	int psize;
+
+	plget->msg.msg_controllen = sizeof(plget->control);
+	plget->msg.msg_namelen = sizeof(plget->rx_peer);
+	psize = rxlat_recvmsg(&ts, &ts_id);
+
+	if (psize < 0) {
+		if (errno == EINTR || errno == EAGAIN)
+			return 1;
+
+		return perror("recvmsg"), -errno;
+	}
+
+	if (rxlat_seq(ts_id))
+		return 1;
+
+	rxlat_handle_ts(&plget->msg, &ts, ts_id);
+	plget->sk_payload_size = psize;
+
+	/* only packets that are measured are counted per wait */
+	if (plget->flags & PLF_ADAPTIVE) {
+		if (plget->rx_group == RX_GROUP_SPIN)
+			plget->spin_cnt++;
+		else
+			plget->block_cnt++;
+	}
+
+	if (plget->rx_groups)
+		plget->rx_groups[ts_id] = plget->rx_group;
+
+	if (plget->rx_cpus)
+		rxlat_get_cpu(ts_id);
+
+	return 0;
+}
+
+void rxlat_proc_packet(void)
+{
+	rxlat_recv_packet();
+}
+
+/* allocate batch of messages, each with own data and control buffer */
+static int rxlat_init_batch(void)
+{
+	int i, num = plget->batch;
+	struct mmsghdr *mmsg;
+	char *data, *control;
+	struct iovec *iov;
+
+	mmsg = calloc(num, sizeof(*mmsg));
+	iov = calloc(num, sizeof(*iov));
+	data = malloc(num * ETH_FRAME_LEN);
+	control = malloc(num * CONTROL_LEN);
+	if (!mmsg || !iov || !data || !control) {
+		free(mmsg);
+		free(iov);
+		free(data);
+		free(control);
+		return perror("Cannot allocate rx batch"), -ENOMEM;
+	}
+
+	for (i = 0; i < num; i++) {
+		iov[i].iov_base = data + i * ETH_FRAME_LEN;
+		iov[i].iov_len = ETH_FRAME_LEN;
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+		mmsg[i].msg_hdr.msg_control = control + i * CONTROL_LEN;
+	}
+
+	plget->mmsg = mmsg;
+	return 0;
+}
+
+static void rxlat_free_batch(void)
+{
+	struct mmsghdr *mmsg = plget->mmsg;
+
+	free(mmsg[0].msg_hdr.msg_control);
+	free(mmsg[0].msg_hdr.msg_iov->iov_base);
+	free(mmsg[0].msg_hdr.msg_iov);
+	free(mmsg);
+	plget->mmsg = NULL;
+	plget->rx_pkt = plget->data;
+}
+
+static int rxlat_recvmmsg(int num, int flags)
+{
+	int i, ret;
+
+	for (i = 0; i < num; i++)
+		plget->mmsg[i].msg_hdr.msg_controllen = CONTROL_LEN;
+
+	ret = recvmmsg(plget->sfd, plget->mmsg, num, flags, NULL);
+	if (ret < 0 && errno != EAGAIN && errno != EINTR)
+		perror("recvmmsg");
+
+	return ret;
+}
+
+/*
+ * Receive up to batch packets per syscall. MSG_WAITFORONE blocks only
+ * till first packet, so app timestamp is taken once per batch and is
+ * related to last packet in it rather than to each packet.
+ */
+static int rxlat_proc_batch(void)
+{
+	int i, num, psize, flags;
+	struct msghdr *msg;
+	struct timespec ts;
+	__u32 ts_id;
+
+	flags = MSG_WAITFORONE;
+	if (plget->flags & PLF_SW_POLL)
+		flags = MSG_DONTWAIT;
+
+	if (rxlat_use_epoll()) {
+		if (rxlat_epoll_wait() < 0)
+			return errno == EINTR ? 0 : -errno;
+
+		flags = MSG_DONTWAIT;
+	}
+
+	num = plget->pkt_num - plget->icnt;
+	if (num > plget->batch)
+		num = plget->batch;
+
+	num = rxlat_recvmmsg(num, flags);
+	if (num < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -errno;
+
+	if (clock_gettime(CLOCK_REALTIME, &ts))
+		return perror("clock_gettime"), -errno;
+
+	for (i = 0; i < num; i++) {
+		msg = &plget->mmsg[i].msg_hdr;
+		psize = plget->mmsg[i].msg_len;
+		plget->rx_pkt = msg->msg_iov->iov_base;
+
+		if (rxlat_check_pkt(psize, &ts_id) || rxlat_seq(ts_id))
+			continue;
+
+		rxlat_handle_ts(msg, &ts, ts_id);
+		plget->sk_payload_size = psize;
+		plget->icnt++;
+	}
+
+	return 0;
+}
+
+static int rxlat_batch(void)
+{
+	int ret;
+
+	ret = rxlat_init_batch();
+	if (ret)
+		return ret;
+
+	for (plget->icnt = 0; rxlat_more();) {
+		ret = rxlat_proc_batch();
+		if (ret)
+			break;
+	}
+
+	rxlat_free_batch();
+	return ret;
+}
+
+/*
+ * Process whole ring block per wakeup. Ring frame has only one timestamp,
+ * h/w one if present or s/w otherwise, app timestamp is taken once per
+ * block and includes block retire timeout.
+ */
+static int rxlat_ring_proc_block(void)
+{
+	struct rx_frame frame;
+	struct timespec ts;
+	int i, num;
+	__u32 ts_id;
+
+	if (rxlat_use_epoll()) {
+		while (!(num = rx_ring_block()))
+			if (rxlat_epoll_wait() < 0)
+				return errno == EINTR ? 0 : -errno;
+	} else {
+		num = rx_ring_wait_block(plget->sfd,
+					 plget->flags & PLF_SW_POLL);
+		if (num <= 0)
+			return num == -EINTR ? 0 : num;
+	}
+
+	if (clock_gettime(CLOCK_REALTIME, &ts))
+		return perror("clock_gettime"), -errno;
+
+	for (i = 0; i < num && plget->icnt < plget->pkt_num; i++) {
+		rx_ring_frame(&frame);
+		plget->rx_pkt = frame.data;
+		if (rxlat_check_pkt(frame.snaplen, &ts_id) || rxlat_seq(ts_id))
+			continue;
+
+		if (frame.hw)
+			rxlat_push_ts(ts_ns(&ts), 0, frame.ts, ts_id);
+		else
+			rxlat_push_ts(ts_ns(&ts), frame.ts, 0, ts_id);
+
+		plget->sk_payload_size = frame.snaplen;
+		plget->icnt++;
+	}
+
+	rx_ring_block_done();
+	return 0;
+}
+
+static int rxlat_ring(void)
+{
+	int ret = 0;
+
+	for (plget->icnt = 0; rxlat_more();) {
+		ret = rxlat_ring_proc_block();
+		if (ret)
+			break;
+	}
+
+	plget->rx_pkt = plget->data;
+	rx_ring_release();
+	return ret;
+}
+
+/*
+ * Multishot recvmsg puts packets to provided buffers w/o syscall per
+ * packet, so all completions found after wakeup get same app timestamp.
+ */
+static int rxlat_uring_proc(void)
+{
+	struct timespec ts;
+	struct msghdr msg;
+	int psize, ret;
+	__u32 ts_id;
+
+	ret = uring_rx_wait(plget->flags & PLF_SW_POLL);
+	if (ret)
+		return ret == -EINTR ? 0 : ret;
+
+	if (clock_gettime(CLOCK_REALTIME, &ts))
+		return perror("clock_gettime"), -errno;
+
+	while (plget->icnt < plget->pkt_num) {
+		psize = uring_rx_peek(&msg, &plget->rx_pkt);
+		if (psize == -EAGAIN)
+			break;
+
+		if (psize < 0)
+			return psize;
+
+		if (!rxlat_check_pkt(psize, &ts_id) && !rxlat_seq(ts_id)) {
+			rxlat_handle_ts(&msg, &ts, ts_id);
+			plget->sk_payload_size = psize;
+			plget->icnt++;
+		}
+
+		uring_rx_done();
+	}
+
+	return 0;
+}
+
+static int rxlat_uring(void)
+{
+	int ret = 0;
+
+	for (plget->icnt = 0; rxlat_more();) {
+		ret = rxlat_uring_proc();
+		if (ret)
+			break;
+	}
+
+	plget->rx_pkt = plget->data;
+	uring_release();
+	return ret;
+}
+
+/*
+ * Idle timer ends the run if no new packet is received for whole period,
+ * first one including. Signal interrupts blocking waits as it's w/o
+ * SA_RESTART, it's sent to rx-lat thread only, as handler reads its plget.
+ */
+static timer_t rxlat_idle_timer;
+
+static void rxlat_idle_tick(int sig)
+{
+	/* corrupted packets are also received ones */
+	unsigned long cnt = plget->icnt + plget->rx_seq.corrupt;
+
+	if (cnt == plget->idle_icnt)
+		plget->rx_idle = 1;
+
+	plget->idle_icnt = cnt;
+}
+
+static int rxlat_idle_start(void)
+{
+	struct itimerspec its;
+	struct sigaction sa;
+	struct sigevent sev;
+	int ret;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = rxlat_idle_tick;
+	if (sigaction(SIGALRM, &sa, NULL))
+		return perror("Couldn't set idle timer handler"), -errno;
+
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGALRM;
+	sev.sigev_notify_thread_id = syscall(__NR_gettid);
+	if (timer_create(CLOCK_MONOTONIC, &sev, &rxlat_idle_timer))
+		return perror("Couldn't create idle timer"), -errno;
+
+	its.it_interval.tv_sec = plget->idle_timeout / 1000;
+	its.it_interval.tv_nsec = plget->idle_timeout % 1000 * 1000000;
+	its.it_value = its.it_interval;
+	if (timer_settime(rxlat_idle_timer, 0, &its, NULL)) {
+		ret = -errno;
+		perror("Couldn't start idle timer");
+		timer_delete(rxlat_idle_timer);
+		return ret;
+	}
+
+	return 0;
+}
+
+static void rxlat_idle_stop(void)
+{
+	timer_delete(rxlat_idle_timer);
+}
+
+/* rx vectors are indexed by id, drop holes left by lost packets */
+void rxlat_compact(void)
+{
+	__u8 *seen = plget->rx_seq.seen;
+	struct rx_stream *s;
+	__u32 id, num = 0;
+	int i;
+
+	if (plget->rx_streams) {
+		for (i = 0; i < STREAM_NUM; i++) {
+			s = &plget->rx_streams[i];
+			stats_compact(&s->app_v, s->seq.seen);
+			stats_compact(&s->sw_v, s->seq.seen);
+			stats_compact(&s->hw_v, s->seq.seen);
+			if (plget->flags & PLF_TX_TS)
+				stats_compact(&s->snd_v, s->seq.seen);
+		}
+
+		return;
+	}
+
+	stats_compact(&rx_app_v, seen);
+	stats_compact(&rx_sw_v, seen);
+	stats_compact(&rx_hw_v, seen);
+	if (plget->flags & PLF_TX_TS)
+		stats_compact(&rx_snd_v, seen);
+
+	for (id = 0; id < plget->pkt_num; id++) {
+		if (!seen[id])
+			continue;
+
+		if (plget->rx_groups)
+			plget->rx_groups[num] = plget->rx_groups[id];
+
+		if (plget->rx_cpus) {
+			plget->rx_cpus[num] = plget->rx_cpus[id];
+			plget->rx_napis[num] = plget->rx_napis[id];
+		}
+
+		num++;
+	}
+}
+
+/* forget received packets to run rx-lat again, sender isn't restarted */
+void rxlat_reset(void)
+{
+	__u8 *seen = plget->rx_seq.seen;
+
+	stats_reset(&rx_app_v);
+	stats_reset(&rx_sw_v);
+	stats_reset(&rx_hw_v);
+	stats_reset(&rx_snd_v);
+
+	memset(&plget->rx_seq, 0, sizeof(plget->rx_seq));
+	plget->rx_seq.seen = seen;
+	if (seen)
+		memset(seen, 0, plget->pkt_num);
+
+	plget->icnt = 0;
+	plget->idle_icnt = 0;
+	plget->rx_idle = 0;
+	plget->rx_rebase = 1;
+}
+
+static int rxlat_run(void)
+{
+	int ret;
+
+	if (plget->flags & PLF_RX_RING)
+		return rxlat_ring();
+
+	if (plget->flags & PLF_URING)
+		return rxlat_uring();
+
+	if (plget->batch > 1)
+		return rxlat_batch();
+
+	for (plget->icnt = 0; rxlat_more();) {
+		ret = rxlat_recv_packet();
+		if (ret < 0)
+			return ret;
+
+		if (!ret)
+			plget->icnt++;
+	}
+
+	return 0;
+}
+
+/* fanout workers are stopped and their results merged by main thread */
+int rxlat(void)
+{
+	int ret;
+
+	plget->inum = plget->pkt_num;
+	if (plget->flags & PLF_FANOUT)
+		return rxlat_run();
+
+	if (plget->idle_timeout) {
+		ret = rxlat_idle_start();
+		if (ret)
+			return ret;
+	}
+
+	ret = rxlat_run();
+
+	if (plget->idle_timeout)
+		rxlat_idle_stop();
+
+	rxlat_compact();
+	return ret;
+}
+
+/* get packet timestamp in ns, returns 1 if it's h/w one */
+static int rxrate_get_ts(struct msghdr *msg, __u64 *ts)
 {
-	struct scm_timestamping *tss = NULL;
-	struct msghdr *msg = &plget->msg;
-	struct cmsghdr *cmsg;
+	struct scm_timestamping *tss;
 
-	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
-		if (cmsg->cmsg_level != SOL_SOCKET ||
-			cmsg->cmsg_type != SCM_TIMESTAMPING)
-			continue;
+	tss = rxlat_get_tss(msg);
+	if (!tss)
+		return -1;
 
-		tss = (struct scm_timestamping *) CMSG_DATA(cmsg);
-		break;
+	if (ts_correct(tss->ts + 2)) {
+		*ts = ts_ns(tss->ts + 2);
+		return 1;
+	}
+
+	*ts = ts_ns(tss->ts);
+	return 0;
+}
+
+/* whole run of rx-rate counter, for summary */
+struct rxrate_total {
+	struct stats_hist gaps;
+	__u64 pnum;
+	__u64 dsize;
+	__u64 lost;
+	__u64 reorder;
+	double pps_min;
+	double pps_max;
+	double pps_sum;
+	double jitter_min;
+	double jitter_max;
+	double jitter_sum;
+	int burst_max;
+	int ival_num;
+};
+
+struct rxrate_cnt {
+	__u64 first;			/* ns timestamps of packets */
+	__u64 last;
+	__u64 prev;			/* ts of previous packet */
+	__u64 dsize;
+	int pnum;
+	int hsize;
+	int hw;
+	/* interval stats of packets, all are taken in O(1) per packet */
+	struct stats_hist gaps;
+	__u64 lost;			/* sum of sequence id gaps */
+	__u64 reorder;			/* came after packet with higher id */
+	int burst;			/* back-to-back packets in a row */
+	int burst_max;
+	/* running over intervals */
+	__s64 gap;			/* to previous packet, -1 for first */
+	__s64 jitter_ref;		/* transit or gap of previous packet */
+	double jitter;			/* RFC 3550 estimate, ns */
+	__u32 next_id;
+	__u32 first_id;
+	__u64 seq_num;			/* packets with id, for fanout loss */
+	int seq_on;
+	int jitter_on;
+	struct rxrate_total total;
+	struct rxrate_cnt *streams;	/* STREAM_NUM counters if demuxed */
+};
+
+static int rxrate_speed;
+static volatile int rxrate_stop;
+
+/* returns 0 if packet is one of ours, its stream id is put in sid */
+static int rxrate_parse(char *data, int size, int *sid)
+{
+	plget->rx_pkt = data;
+	plget->rx_len = size;
+	if ((plget->pkt_type == PKT_RAW || plget->pkt_type == PKT_XDP) &&
+	    !rxlat_raw_pkt(size))
+		return -1;
+
+	if (plget->rx_off + plget->off_sid_rd >= size ||
+	    *magic_rx_rd() != MAGIC)
+		return -1;
+
+	*sid = sid_rx_rd();
+	return 0;
+}
+
+/* gap to previous packet, packets closer than 2 frame times are a burst */
+static void rxrate_gap(struct rxrate_cnt *cnt)
+{
+	__s64 burst_ns = RXRATE_BURST_NS;
+
+	if (!cnt->prev) {
+		cnt->gap = -1;
+		return;
 	}
 
-	if (!tss) {
-		fprintf(stderr, "SCM_TIMESTAMPING not found!\n");
+	cnt->gap = (__s64)(cnt->last - cnt->prev);
+	if (cnt->gap < 0)
+		cnt->gap = 0;
+
+	stats_hist_add(&cnt->gaps, cnt->gap);
+
+	if (rxrate_speed > 0)
+		burst_ns = 2000LL * 8 * plget->frame_size / rxrate_speed;
+
+	if (cnt->gap > burst_ns) {
+		cnt->burst = 0;
 		return;
 	}
 
-	stats_push_id(&rx_sw_v, tss->ts, ts_id);
-	stats_push_id(&rx_hw_v, tss->ts + 2, ts_id);
-	stats_push_id(&rx_app_v, ts, ts_id);
+	/* first packet of burst is the one before */
+	cnt->burst = cnt->burst ? cnt->burst + 1 : 2;
+	if (cnt->burst > cnt->burst_max)
+		cnt->burst_max = cnt->burst;
 }
 
-static int rxlat_recvmsg_start(struct timespec *ts)
+/*
+ * RFC 3550 interarrival jitter, D is difference of transit times of
+ * consecutive packets. W/o sender ts (-o tx_ts) sender is supposed to keep
+ * gap of previous packet, so D is difference of consecutive gaps.
+ */
+static void rxrate_jitter(struct rxrate_cnt *cnt)
 {
-	int flags, psize;
+	__u64 snd = 0;
+	__s64 ref, d;
 
-	if (plget->pkt_type == PKT_XDP) {
-		psize = xsk_recvmsg_start(ts);
-		return psize;
+	if (plget->flags & PLF_TX_TS)
+		snd = tx_ts_rx_rd();
+
+	if (snd)
+		ref = (__s64)(cnt->last - snd);
+	else if (cnt->gap >= 0)
+		ref = cnt->gap;
+	else
+		return;
+
+	if (cnt->jitter_on) {
+		d = ref - cnt->jitter_ref;
+		if (d < 0)
+			d = -d;
+
+		cnt->jitter += (d - cnt->jitter) / RXRATE_JITTER_DIV;
 	}
 
-	flags = (plget->flags & PLF_SW_POLL) ? MSG_DONTWAIT : 0;
-	do
-		psize = recvmsg(plget->sfd, &plget->msg, flags);
-	while (psize <= 0 && flags);
+	cnt->jitter_ref = ref;
+	cnt->jitter_on = 1;
+}
 
-	if (clock_gettime(CLOCK_REALTIME, ts))
-		return -1;
+/* loss is sum of id gaps, packet coming after higher id isn't subtracted */
+static void rxrate_seq(struct rxrate_cnt *cnt)
+{
+	__u32 id = tid_rx_rd();
+	__s32 dist = id - cnt->next_id;
 
-	return psize;
+	rxrate_jitter(cnt);
+	cnt->seq_num++;
+
+	if (cnt->seq_on && dist < 0) {
+		cnt->reorder++;
+		return;
+	}
+
+	if (cnt->seq_on)
+		cnt->lost += dist;
+
+	if (!cnt->seq_on)
+		cnt->first_id = id;
+
+	cnt->next_id = id + 1;
+	cnt->seq_on = 1;
 }
 
-static int rxlat_recvmsg_raw_filter(int psize)
+static void rxrate_add(struct rxrate_cnt *cnt, int size)
 {
-	int ptp_pkt;
-	__u16 proto;
+	plget->frame_size = size + cnt->hsize;
+	rxrate_gap(cnt);
+	cnt->prev = cnt->last;
+	cnt->dsize += plget->frame_size;
+	if (!cnt->pnum++)
+		cnt->first = cnt->last;
+}
 
-	if (plget->pkt_type != PKT_XDP && plget->pkt_type != PKT_RAW)
-		return 0;
+static void rxrate_count(struct rxrate_cnt *cnt, char *data, int size)
+{
+	struct rxrate_cnt *s;
+	int sid;
 
-	/* drop not expected packets */
-	memcpy(&proto, plget->rx_pkt + ETH_ALEN * 2, sizeof(proto));
-	ptp_pkt = (plget->flags & PLF_PTP) && proto == htons(ETH_P_1588);
-	if (psize < ETH_HLEN || !ptp_pkt) {
-		if (plget->pkt_type == PKT_XDP)
-			xsk_recvmsg_fail();
+	rxrate_add(cnt, size);
+	if (rxrate_parse(data, size, &sid))
+		return;
 
-		return -1;
+	/* ids of different streams are not one sequence */
+	if (!cnt->streams) {
+		rxrate_seq(cnt);
+		return;
 	}
 
-	if (plget->pkt_type == PKT_XDP)
-		xsk_recvmsg_complete(&plget->msg);
+	if (sid >= STREAM_NUM)
+		return;
 
-	return 0;
+	s = &cnt->streams[sid];
+	s->last = cnt->last;
+	s->hw = cnt->hw;
+	rxrate_add(s, size);
+	rxrate_seq(s);
 }
 
-static int rxlat_recvmsg(struct timespec *ts, __u32 *ts_id)
+/* receive up to batch packets at once */
+static int rxrate_recv_batch(struct rxrate_cnt *cnt)
 {
-	char *magic;
-	int psize;
+	int i, num, hw;
 
-	for (;;) {
-		psize = rxlat_recvmsg_start(ts);
-		if (psize < 0)
-			return psize;
+	num = rxlat_recvmmsg(plget->batch, MSG_DONTWAIT);
+	if (num < 0)
+		return errno == EAGAIN ? 0 : -errno;
 
-		if (rxlat_recvmsg_raw_filter(psize))
+	for (i = 0; i < num; i++) {
+		hw = rxrate_get_ts(&plget->mmsg[i].msg_hdr, &cnt->last);
+		if (hw < 0)
 			continue;
 
-		/* check magic number */
-		magic = magic_rx_rd();
-		if (*magic == MAGIC) {
-			*ts_id = tid_rx_rd();
-			if (*ts_id > plget->pkt_num)
-				printf("incorrect ts_id\n");
-			break;
+		cnt->hw = hw;
+		rxrate_count(cnt, plget->mmsg[i].msg_hdr.msg_iov->iov_base,
+			     plget->mmsg[i].msg_len);
+	}
+
+	return 0;
+}
+
+/* process all blocks filled by kernel */
+static int rxrate_recv_ring(struct rxrate_cnt *cnt)
+{
+	struct rx_frame frame;
+	int i, num;
+
+	while ((num = rx_ring_block())) {
+		for (i = 0; i < num; i++) {
+			rx_ring_frame(&frame);
+			cnt->last = frame.ts;
+			cnt->hw = frame.hw;
+			rxrate_count(cnt, frame.data, frame.len);
 		}
 
-		printf("incorrect rx MAGIC number 0x%x\n", *magic);
+		rx_ring_block_done();
 	}
 
-	return psize;
+	return 0;
 }
 
-void rxlat_proc_packet(void)
+/* drain all packets completed by multishot recvmsg */
+static int rxrate_recv_uring(struct rxrate_cnt *cnt)
 {
-	struct timespec ts;
-	__u32 ts_id;
-	int psize;
+	struct msghdr msg;
+	int size, hw;
+	char *data;
 
-	plget->msg.msg_controllen = sizeof(plget->control);
-	psize = rxlat_recvmsg(&ts, &ts_id);
+	while ((size = uring_rx_peek(&msg, &data)) >= 0) {
+		hw = rxrate_get_ts(&msg, &cnt->last);
+		if (hw >= 0) {
+			cnt->hw = hw;
+			rxrate_count(cnt, data, size);
+		}
 
-	if (psize < 0)
-		return perror("recvmsg");
+		/* buffer is reused by kernel after it's returned */
+		uring_rx_done();
+	}
 
-	rxlat_handle_ts(&ts, ts_id);
-	plget->sk_payload_size = psize;
+	return size == -EAGAIN ? 0 : size;
 }
 
-int rxlat(void)
+/* dequeue batch of af_xdp descriptors and refill them at once */
+static int rxrate_recv_xdp(struct rxrate_cnt *cnt)
 {
-	plget->inum = plget->pkt_num;
-	for (plget->icnt = 0; plget->icnt < plget->pkt_num; ++plget->icnt)
-		rxlat_proc_packet();
+	struct rx_frame frames[XSK_RX_BATCH];
+	int i, num;
+
+	num = xsk_recv_frames(frames, XSK_RX_BATCH);
+	for (i = 0; i < num; i++) {
+		cnt->last = frames[i].ts;
+		cnt->hw = frames[i].hw;
+		rxrate_count(cnt, frames[i].data, frames[i].len);
+	}
+
+	return xsk_release_frames();
+}
+
+/* size of headers not seen by socket */
+static int rxrate_hsize(void)
+{
+	int hsize = 0;
+
+	/* raw and xdp sockets get whole frame */
+	if (plget->pkt_type != PKT_RAW && plget->pkt_type != PKT_XDP)
+		hsize += ETH_HLEN;
+
+	if (plget->pkt_type == PKT_UDP)
+		hsize += ip_udp_hlen();
+
+	return hsize;
+}
+
+/* worker is done with counter, main thread must not take it anymore */
+static int rxrate_worker_exit(struct rxrate_sum *sum, struct rxrate_cnt *cnt,
+			      int ret)
+{
+	pthread_mutex_lock(&sum->lock);
+	sum->cnt = NULL;
+	pthread_mutex_unlock(&sum->lock);
+	stats_hist_free(&cnt->gaps);
+	return ret;
+}
+
+/*
+ * rx-rate loop of fanout worker, interval stats of cnt are taken and reset
+ * by main thread under sum lock, so it's held while batch is counted.
+ */
+int rxrate_worker(struct rxrate_sum *sum)
+{
+	struct rxrate_cnt cnt = {0};
+	struct pollfd fds;
+	int ret;
+
+	if (!(plget->flags & PLF_RX_RING)) {
+		ret = rxlat_init_batch();
+		if (ret)
+			return ret;
+	}
+
+	if (stats_hist_init(&cnt.gaps, plget->hist_bits))
+		return -ENOMEM;
+
+	cnt.hsize = rxrate_hsize();
+	fds.fd = plget->sfd;
+	fds.events = POLLIN;
+
+	pthread_mutex_lock(&sum->lock);
+	sum->cnt = &cnt;
+	pthread_mutex_unlock(&sum->lock);
+
+	for (;;) {
+		if (plget->flags & PLF_EPOLL)
+			ret = rxlat_epoll_wait();
+		else
+			ret = poll(&fds, 1, -1);
+
+		if (ret <= 0) {
+			ret = -errno;
+			perror("Some error on poll()");
+			return rxrate_worker_exit(sum, &cnt, ret);
+		}
+
+		pthread_mutex_lock(&sum->lock);
+		if (plget->flags & PLF_RX_RING)
+			ret = rxrate_recv_ring(&cnt);
+		else
+			ret = rxrate_recv_batch(&cnt);
+
+		sum->frame_size = plget->frame_size;
+		pthread_mutex_unlock(&sum->lock);
+		if (ret)
+			return rxrate_worker_exit(sum, &cnt, ret);
+	}
 
 	return 0;
 }
 
-static int rxrate_proc_packet(struct timespec *ts)
+/* wait for packets or timer, epoll events are put to revents of fds */
+static int rxrate_wait(struct pollfd *fds)
 {
-	struct msghdr *msg = &plget->msg;
-	struct scm_timestamping *tss = NULL;
-	struct cmsghdr *cmsg;
-	int psize;
+	struct epoll_event evs[2];
+	int i, ret;
 
-	msg->msg_controllen = sizeof(plget->control);
-	psize = recvmsg(plget->sfd, msg, 0);
-	if (psize < 0) {
-		return perror("recvmsg"), -errno;
+	if (!(plget->flags & PLF_EPOLL))
+		return poll(fds, 2, -1);
+
+	ret = epoll_wait(plget->epfd, evs, 2, -1);
+
+	fds[0].revents = 0;
+	fds[1].revents = 0;
+	for (i = 0; i < ret; i++) {
+		if (evs[i].data.fd == plget->sfd)
+			fds[0].revents = evs[i].events;
+		else
+			fds[1].revents = evs[i].events;
 	}
 
-	plget->frame_size = psize;
-	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
-		if (cmsg->cmsg_level != SOL_SOCKET ||
-			cmsg->cmsg_type != SCM_TIMESTAMPING)
+	return ret;
+}
+
+static void rxrate_sig_stop(int sig)
+{
+	rxrate_stop = 1;
+}
+
+/* ctrl-c ends rx-rate with summary, waits are interrupted w/o SA_RESTART */
+static int rxrate_stop_init(void)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = rxrate_sig_stop;
+	if (sigaction(SIGINT, &sa, NULL) || sigaction(SIGTERM, &sa, NULL))
+		return perror("Couldn't set stop handler"), -errno;
+
+	return 0;
+}
+
+static int rxrate_cnt_init(struct rxrate_cnt *cnt)
+{
+	if (stats_hist_init(&cnt->gaps, plget->hist_bits) ||
+	    stats_hist_init(&cnt->total.gaps, plget->hist_bits))
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void rxrate_cnt_free(struct rxrate_cnt *cnt)
+{
+	stats_hist_free(&cnt->gaps);
+	stats_hist_free(&cnt->total.gaps);
+}
+
+/* add interval to summary */
+static void rxrate_total_add(struct rxrate_cnt *cnt, double pps)
+{
+	struct rxrate_total *t = &cnt->total;
+
+	/* idle intervals before first or after last packet aren't counted */
+	if (!cnt->pnum)
+		return;
+
+	if (!t->ival_num || pps < t->pps_min)
+		t->pps_min = pps;
+
+	if (!t->ival_num || cnt->jitter < t->jitter_min)
+		t->jitter_min = cnt->jitter;
+
+	if (pps > t->pps_max)
+		t->pps_max = pps;
+
+	if (cnt->jitter > t->jitter_max)
+		t->jitter_max = cnt->jitter;
+
+	if (cnt->burst_max > t->burst_max)
+		t->burst_max = cnt->burst_max;
+
+	t->pps_sum += pps;
+	t->jitter_sum += cnt->jitter;
+	t->lost += cnt->lost;
+	t->reorder += cnt->reorder;
+	t->pnum += cnt->pnum;
+	t->dsize += cnt->dsize;
+	t->ival_num++;
+	stats_hist_merge(&t->gaps, &cnt->gaps);
+}
+
+/* print gap percentiles in us */
+static void rxrate_gaps_print(struct stats_hist *h)
+{
+	printf("GAP p50/p99/p99.9/max = %.3f/%.3f/%.3f/%.3fus",
+	       stats_hist_pct(h, 50) / 1000.0, stats_hist_pct(h, 99) / 1000.0,
+	       stats_hist_pct(h, 99.9) / 1000.0, h->max / 1000.0);
+}
+
+/* print stats of last interval in one line and reset counter */
+static void rxrate_print(struct rxrate_cnt *cnt)
+{
+	__u64 val, pnum, dsize;
+	double pps;
+
+	pnum = cnt->pnum;
+	dsize = cnt->dsize;
+	val = cnt->last - cnt->first;
+
+	/* af_xdp frames w/o ts metadata of one batch have same ts */
+	if (cnt->pnum <= 1 || !val) {
+		val = ts_ns(&plget->interval);
+	} else {
+		dsize -= plget->frame_size;
+		pnum--;
+	}
+
+	pps = (double)pnum * NSEC_PER_SEC / val;
+	rxrate_total_add(cnt, pps);
+
+	cnt->hw ? printf("H/W ") : printf("S/W ");
+	printf("RATE = %.2fkbps, PPS = %.1f, ",
+	       (double)dsize * 8 * USEC_PER_SEC / val, pps);
+
+	if (cnt->seq_on)
+		printf("LOST = %llu (%.2f%%), REORD = %llu, JITTER = %.3fus, ",
+		       cnt->lost, cnt->lost ?
+		       cnt->lost * 100.0 / (cnt->lost + cnt->pnum) : 0.0,
+		       cnt->reorder, cnt->jitter / 1000.0);
+
+	printf("BURST = %d, ", cnt->burst_max);
+	rxrate_gaps_print(&cnt->gaps);
+	printf("\n");
+
+	stats_hist_reset(&cnt->gaps);
+	cnt->lost = 0;
+	cnt->reorder = 0;
+	cnt->burst_max = 0;
+	cnt->dsize = 0;
+	cnt->pnum = 0;
+}
+
+/* summary of whole run, min/avg/max are over intervals */
+static void rxrate_total_print(struct rxrate_cnt *cnt)
+{
+	struct rxrate_total *t = &cnt->total;
+
+	if (!t->ival_num)
+		return;
+
+	printf("packets %llu, bytes %llu, intervals %d", t->pnum, t->dsize,
+	       t->ival_num);
+	if (cnt->seq_on)
+		printf(", lost %llu (%.4f%%), reordered %llu", t->lost,
+		       t->lost * 100.0 / (t->lost + t->pnum), t->reorder);
+
+	printf("\n");
+	printf("%-12s|%16s|%16s|%16s\n", "", "min", "avg", "max");
+	printf("%-12s|%16.1f|%16.1f|%16.1f\n", "PPS", t->pps_min,
+	       t->pps_sum / t->ival_num, t->pps_max);
+	if (cnt->seq_on)
+		printf("%-12s|%16.3f|%16.3f|%16.3f\n", "JITTER, us",
+		       t->jitter_min / 1000.0,
+		       t->jitter_sum / t->ival_num / 1000.0,
+		       t->jitter_max / 1000.0);
+
+	printf("%-12s|%16s|%16s|%16d\n", "BURST", "", "", t->burst_max);
+	rxrate_gaps_print(&t->gaps);
+	printf("\n");
+}
+
+static void rxrate_summary_print(struct rxrate_cnt *cnt)
+{
+	int i;
+
+	printf("\nrx-rate summary:\n");
+	rxrate_total_print(cnt);
+	for (i = 0; cnt->streams && i < STREAM_NUM; i++) {
+		if (!cnt->streams[i].total.ival_num)
 			continue;
 
-		tss = (struct scm_timestamping *) CMSG_DATA(cmsg);
-		break;
+		printf("\nstream %d: ", i);
+		rxrate_total_print(&cnt->streams[i]);
 	}
+}
 
-	if (!tss) {
-		fprintf(stderr, "SCM_TIMESTAMPING not found!\n");
-		return -1;
+/* fanout workers' interval counters merged by main thread */
+static struct rxrate_fanout {
+	struct rxrate_cnt cnt;
+	__u64 seq_num;		/* packets with id of all workers */
+	__u64 lost;		/* printed so far */
+	__u32 first_id;
+	double jitter;		/* sum of worker jitters weighted by packets */
+	__u64 jitter_num;
+} rxrate_fo;
+
+int rxrate_fanout_init(void)
+{
+	rxrate_fo.cnt.hsize = rxrate_hsize();
+	rxrate_speed = res_get_intf_speed();
+	if (rxrate_cnt_init(&rxrate_fo.cnt))
+		return -ENOMEM;
+
+	return rxrate_stop_init();
+}
+
+int rxrate_stopped(void)
+{
+	return rxrate_stop;
+}
+
+/* add interval stats of worker to main counter, returns worker packets */
+__u64 rxrate_fanout_take(struct rxrate_sum *sum)
+{
+	struct rxrate_cnt *cnt = &rxrate_fo.cnt;
+	struct rxrate_cnt *w;
+	__u64 pnum;
+
+	pthread_mutex_lock(&sum->lock);
+	w = sum->cnt;
+	if (!w || !w->pnum) {
+		pthread_mutex_unlock(&sum->lock);
+		return 0;
 	}
 
-	if (ts_correct(tss->ts + 2)) {
-		ts->tv_sec = (tss->ts + 2)->tv_sec;
-		ts->tv_nsec = (tss->ts + 2)->tv_nsec;
-		return 1;
+	if (!cnt->pnum || w->first < cnt->first)
+		cnt->first = w->first;
+
+	if (w->last > cnt->last)
+		cnt->last = w->last;
+
+	if (w->burst_max > cnt->burst_max)
+		cnt->burst_max = w->burst_max;
+
+	/* ids are spread over workers, so loss is by highest id of all */
+	if (w->seq_on && (!cnt->seq_on ||
+			  (__s32)(w->first_id - rxrate_fo.first_id) < 0))
+		rxrate_fo.first_id = w->first_id;
+
+	if (w->seq_on && (!cnt->seq_on ||
+			  (__s32)(w->next_id - cnt->next_id) > 0))
+		cnt->next_id = w->next_id;
+
+	if (w->jitter_on) {
+		rxrate_fo.jitter += w->jitter * w->pnum;
+		rxrate_fo.jitter_num += w->pnum;
 	}
 
-	ts->tv_sec = tss->ts->tv_sec;
-	ts->tv_nsec = tss->ts->tv_nsec;
-	return 0;
+	pnum = w->pnum;
+	cnt->pnum += w->pnum;
+	cnt->dsize += w->dsize;
+	cnt->reorder += w->reorder;
+	cnt->seq_on |= w->seq_on;
+	cnt->hw |= w->hw;
+	rxrate_fo.seq_num += w->seq_num;
+	plget->frame_size = sum->frame_size;
+	stats_hist_merge(&cnt->gaps, &w->gaps);
+
+	stats_hist_reset(&w->gaps);
+	w->seq_num = 0;
+	w->reorder = 0;
+	w->burst_max = 0;
+	w->dsize = 0;
+	w->pnum = 0;
+	pthread_mutex_unlock(&sum->lock);
+	return pnum;
+}
+
+/*
+ * print interval of all workers, packet filling id gap of previous interval
+ * is not subtracted from loss printed already
+ */
+void rxrate_fanout_print(void)
+{
+	struct rxrate_cnt *cnt = &rxrate_fo.cnt;
+	__s64 lost;
+
+	if (cnt->seq_on) {
+		lost = (__u32)(cnt->next_id - rxrate_fo.first_id);
+		lost -= rxrate_fo.seq_num + rxrate_fo.lost;
+		cnt->lost = lost > 0 ? lost : 0;
+		rxrate_fo.lost += cnt->lost;
+	}
+
+	if (rxrate_fo.jitter_num) {
+		cnt->jitter = rxrate_fo.jitter / rxrate_fo.jitter_num;
+		rxrate_fo.jitter = 0;
+		rxrate_fo.jitter_num = 0;
+	}
+
+	rxrate_print(cnt);
+}
+
+void rxrate_fanout_done(void)
+{
+	rxrate_summary_print(&rxrate_fo.cnt);
+	rxrate_cnt_free(&rxrate_fo.cnt);
 }
 
 int rxrate_proc(void)
 {
-	struct timespec interval, first, last;
-	int dsize = 0, pnum = 0, hw = 0;
-	int hsize = ETH_HLEN;
+	struct rxrate_cnt streams[STREAM_NUM] = {0};
+	struct rxrate_cnt cnt = {0};
+	struct epoll_event ev;
 	struct pollfd fds[2];
+	unsigned int drops;
 	uint64_t exps;
-	int ret;
+	int i, ret;
 
-	if (plget->pkt_type == PKT_UDP)
-		hsize += 28;
+	cnt.hsize = rxrate_hsize();
+	rxrate_speed = res_get_intf_speed();
+	if (rxrate_cnt_init(&cnt))
+		return -ENOMEM;
+
+	if (plget->flags & PLF_STREAMS) {
+		for (i = 0; i < STREAM_NUM; i++) {
+			streams[i].hsize = cnt.hsize;
+			if (rxrate_cnt_init(&streams[i]))
+				return -ENOMEM;
+		}
+
+		cnt.streams = streams;
+	}
+
+	ret = rxrate_stop_init();
+	if (ret)
+		return ret;
 
 	ret = plget_start_timer();
 	if (ret)
 		return ret;
 
-	fds[0].fd = plget->sfd;
+	/* io_uring fd is readable when there are completions */
+	fds[0].fd = plget->flags & PLF_URING ? uring_fd() : plget->sfd;
 	fds[0].events = POLLIN;
 	fds[1].fd = plget->timer_fd;
 	fds[1].events = POLLIN;
 
-	for (;;) {
-		ret = poll(fds, 2, -1);
+	if (plget->flags & PLF_EPOLL) {
+		ev.events = EPOLLIN;
+		ev.data.fd = plget->timer_fd;
+		ret = epoll_ctl(plget->epfd, EPOLL_CTL_ADD, plget->timer_fd,
+				&ev);
+		if (ret < 0)
+			return perror("Couldn't add timer to epoll"), -errno;
+	}
+
+	while (!rxrate_stop) {
+		ret = rxrate_wait(fds);
+		if (ret < 0 && errno == EINTR)
+			continue;
+
 		if (ret <= 0)
 			return perror("Some error on poll()"), -errno;
 
-		/* receive packet */
+		/* receive packets */
 		if (fds[0].revents & POLLIN) {
-			hw = rxrate_proc_packet(&last);
-			if (hw >= 0) {
-				plget->frame_size += hsize;
-				dsize += plget->frame_size;
-				if (!pnum++)
-					first = last;
-			}
+			if (plget->pkt_type == PKT_XDP)
+				ret = rxrate_recv_xdp(&cnt);
+			else if (plget->flags & PLF_RX_RING)
+				ret = rxrate_recv_ring(&cnt);
+			else if (plget->flags & PLF_URING)
+				ret = rxrate_recv_uring(&cnt);
+			else
+				ret = rxrate_recv_batch(&cnt);
+
+			if (ret)
+				return ret;
 		}
 
 		/* print speed */
@@ -232,25 +1653,32 @@ int rxrate_proc(void)
 			if (ret < 0)
 				return perror("Couldn't read timerfd"), -errno;
 
-			if (pnum <= 1) {
-				interval = plget->interval;
-			} else {
-				ts_sub(&last, &first, &interval);
-				dsize -= plget->frame_size;
-				pnum--;
+			rxrate_print(&cnt);
+			for (i = 0; cnt.streams && i < STREAM_NUM; i++) {
+				if (!streams[i].pnum)
+					continue;
+
+				printf("stream %d: ", i);
+				rxrate_print(&streams[i]);
 			}
 
-			hw ? printf("H/W ") : printf("S/W ");
-			stats_drate_print(&interval, pnum, dsize);
-			dsize = 0;
-			pnum = 0;
+			if (plget->flags & PLF_RX_RING) {
+				drops = rx_ring_drops(plget->sfd);
+				if (drops)
+					printf("DROPPED BY SOCKET = %u\n", drops);
+			}
 		}
 	}
 
+	rxrate_summary_print(&cnt);
+	for (i = 0; cnt.streams && i < STREAM_NUM; i++)
+		rxrate_cnt_free(&streams[i]);
+
+	rxrate_cnt_free(&cnt);
 	return 0;
 }
 
-static int init_rxrate(void)
+int init_rxrate(void)
 {
 	if (!ts_correct(&plget->interval))
 		plget->interval.tv_sec = 1;
@@ -266,8 +1694,31 @@ int rxrate(void)
 	if (ret)
 		return ret;
 
+	if (plget->pkt_type == PKT_XDP) {
+		ret = rxrate_proc();
+		goto out;
+	}
+
+	if (plget->flags & PLF_RX_RING) {
+		ret = rxrate_proc();
+		rx_ring_release();
+		goto out;
+	}
+
+	if (plget->flags & PLF_URING) {
+		ret = rxrate_proc();
+		uring_release();
+		goto out;
+	}
+
+	ret = rxlat_init_batch();
+	if (ret)
+		goto out;
+
 	ret = rxrate_proc();
 
+	rxlat_free_batch();
+out:
 	close(plget->timer_fd);
 	return ret;
 }
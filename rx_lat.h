@@ -16,9 +16,29 @@
 #define RX_LAT_H
 
 #include "plget.h"
+#include <pthread.h>
+
+struct rxrate_cnt;
+
+/* interval counter of rx-rate fanout worker, taken by main thread */
+struct rxrate_sum {
+	pthread_mutex_t lock;
+	struct rxrate_cnt *cnt;		/* NULL until worker is receiving */
+	int frame_size;
+};
 
 int rxlat(void);
 int rxrate(void);
+int init_rxrate(void);
+int rxrate_worker(struct rxrate_sum *sum);
+int rxrate_fanout_init(void);
+__u64 rxrate_fanout_take(struct rxrate_sum *sum);
+void rxrate_fanout_print(void);
+void rxrate_fanout_done(void);
+int rxrate_stopped(void);
 void rxlat_proc_packet(void);
+void rxlat_compact(void);
+void rxlat_reset(void);
+int rxlat_hist_init(void);
 
 #endif
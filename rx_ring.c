@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "rx_ring.h"
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <poll.h>
+
+#define RING_BLOCK_SIZE		(1 << 18)
+#define RING_BLOCK_NUM		64
+#define RING_FRAME_SIZE		2048
+/* block is retired by timeout in ms even if it's not full */
+#define RING_BLOCK_TOV		1
+
+struct rx_ring {
+	char *map;
+	size_t size;
+	unsigned int blk;		/* block to be read next */
+	struct tpacket_block_desc *pbd;	/* current block */
+	struct tpacket3_hdr *ppd;	/* next frame in current block */
+};
+
+static __thread struct rx_ring ring;
+
+/* returns number of frames in current block if it's owned by user */
+int rx_ring_block(void)
+{
+	struct tpacket_block_desc *pbd;
+
+	pbd = (struct tpacket_block_desc *)(ring.map +
+					    ring.blk * RING_BLOCK_SIZE);
+
+	if (!(__atomic_load_n(&pbd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+	      TP_STATUS_USER))
+		return 0;
+
+	ring.pbd = pbd;
+	ring.ppd = (struct tpacket3_hdr *)((char *)pbd +
+					   pbd->hdr.bh1.offset_to_first_pkt);
+	return pbd->hdr.bh1.num_pkts;
+}
+
+/* in sw poll mode it doesn't wait, returns -EINTR if wait is interrupted */
+int rx_ring_wait_block(int sfd, int sw_poll)
+{
+	struct pollfd pfd;
+	int num;
+
+	pfd.fd = sfd;
+	pfd.events = POLLIN | POLLERR;
+	pfd.revents = 0;
+
+	while (!(num = rx_ring_block()) && !sw_poll) {
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				return -EINTR;
+
+			return perror("Some error on poll()"), -errno;
+		}
+	}
+
+	return num;
+}
+
+/* read next frame of current block */
+void rx_ring_frame(struct rx_frame *frame)
+{
+	struct tpacket3_hdr *ppd = ring.ppd;
+
+	frame->data = (char *)ppd + ppd->tp_mac;
+	frame->snaplen = ppd->tp_snaplen;
+	frame->len = ppd->tp_len;
+	frame->ts = (__u64)ppd->tp_sec * 1000000000ULL + ppd->tp_nsec;
+	frame->hw = !!(ppd->tp_status & TP_STATUS_TS_RAW_HARDWARE);
+
+	ring.ppd = (struct tpacket3_hdr *)((char *)ppd + ppd->tp_next_offset);
+}
+
+/* give block back to kernel and move to next one */
+void rx_ring_block_done(void)
+{
+	__atomic_store_n(&ring.pbd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+			 __ATOMIC_RELEASE);
+
+	ring.blk = (ring.blk + 1) % RING_BLOCK_NUM;
+}
+
+/* number of packets dropped by socket since last call */
+unsigned int rx_ring_drops(int sfd)
+{
+	struct tpacket_stats_v3 st;
+	socklen_t len = sizeof(st);
+
+	if (getsockopt(sfd, SOL_PACKET, PACKET_STATISTICS, &st, &len))
+		return perror("Couldn't get packet statistics"), 0;
+
+	return st.tp_drops;
+}
+
+int rx_ring_setup(int sfd, int hwts)
+{
+	int ts_flags = SOF_TIMESTAMPING_RAW_HARDWARE;
+	int ver = TPACKET_V3;
+	struct tpacket_req3 req;
+	int ret;
+
+	ret = setsockopt(sfd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver));
+	if (ret < 0)
+		return perror("Couldn't set TPACKET_V3"), -errno;
+
+	/* s/w timestamp is used if h/w one is absent */
+	if (hwts) {
+		ret = setsockopt(sfd, SOL_PACKET, PACKET_TIMESTAMP, &ts_flags,
+				 sizeof(ts_flags));
+		if (ret < 0)
+			return perror("Couldn't set PACKET_TIMESTAMP"), -errno;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = RING_BLOCK_SIZE;
+	req.tp_block_nr = RING_BLOCK_NUM;
+	req.tp_frame_size = RING_FRAME_SIZE;
+	req.tp_frame_nr = RING_BLOCK_SIZE / RING_FRAME_SIZE * RING_BLOCK_NUM;
+	req.tp_retire_blk_tov = RING_BLOCK_TOV;
+
+	ret = setsockopt(sfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+	if (ret < 0)
+		return perror("Couldn't set PACKET_RX_RING"), -errno;
+
+	ring.size = (size_t)RING_BLOCK_SIZE * RING_BLOCK_NUM;
+	ring.map = mmap(NULL, ring.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			sfd, 0);
+	if (ring.map == MAP_FAILED) {
+		ring.map = NULL;
+		return perror("Couldn't mmap rx ring"), -errno;
+	}
+
+	ring.blk = 0;
+	return 0;
+}
+
+void rx_ring_release(void)
+{
+	if (!ring.map)
+		return;
+
+	munmap(ring.map, ring.size);
+	ring.map = NULL;
+}
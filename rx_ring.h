@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PLGET_RX_RING_H
+#define PLGET_RX_RING_H
+
+#include <linux/types.h>
+
+/* frame read from ring */
+struct rx_frame {
+	char *data;		/* for dgram socket it's network header */
+	int snaplen;		/* captured size */
+	int len;		/* original size */
+	__u64 ts;		/* h/w timestamp if present or s/w one, ns */
+	int hw;
+};
+
+/*
+ * linux/if_packet.h conflicts with netpacket/packet.h used by plget.h,
+ * so ring internals are kept in rx_ring.c
+ */
+int rx_ring_setup(int sfd, int hwts);
+void rx_ring_release(void);
+int rx_ring_block(void);
+int rx_ring_wait_block(int sfd, int sw_poll);
+void rx_ring_frame(struct rx_frame *frame);
+void rx_ring_block_done(void);
+unsigned int rx_ring_drops(int sfd);
+
+#endif
@@ -16,13 +16,21 @@
 #include <stdio.h>
 #include "stat.h"
 #include "plget.h"
+#include "vec.h"
 #include <math.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #define LOG_ENTRY_SIZE		15
 #define LOG_BASE		8
 #define LOG_LINE_SIZE		(LOG_BASE * LOG_ENTRY_SIZE + 1)
 
+/* values of vector are reduced in parallel by chunks of this size */
+#define STATS_CHUNK		4096
+#define STATS_THREAD_MAX	64
+
 /* res = a - b; */
 void ts_sub(struct timespec *a, struct timespec *b, struct timespec *res)
 {
@@ -46,146 +54,625 @@ static inline __u64 stat_num(struct stats *ss)
 	return ss->next_ts - ss->start_ts;
 }
 
-static inline __u64 to_num(struct stats *ss, struct timespec *ts)
+static inline __u64 to_num(struct stats *ss, __u64 *ts)
 {
 	return ts - ss->start_ts;
 }
 
-static inline __u64 to_val(struct timespec *ts)
+/* number of buckets, values below 2^sub_bits are exact */
+static inline int hist_num(int sub_bits)
+{
+	return (64 - sub_bits + 1) << sub_bits;
+}
+
+static inline int hist_idx(struct stats_hist *h, __u64 val)
+{
+	int shift;
+
+	if (val < 1ULL << h->sub_bits)
+		return val;
+
+	shift = 63 - __builtin_clzll(val) - h->sub_bits;
+	return (shift << h->sub_bits) + (val >> shift);
+}
+
+/* middle of values counted in bucket */
+static inline __u64 hist_val(struct stats_hist *h, int idx)
+{
+	int shift = (idx >> h->sub_bits) - 1;
+
+	if (shift <= 0)
+		return idx;
+
+	return ((__u64)(idx - (shift << h->sub_bits)) << shift) +
+	       (1ULL << (shift - 1));
+}
+
+/* sub-buckets per power of 2 to keep given number of significant digits */
+int stats_hist_bits(int digits)
+{
+	int bits = 0;
+	__u64 sub = 1;
+
+	while (digits--)
+		sub *= 10;
+
+	while (1ULL << bits < sub)
+		bits++;
+
+	return bits;
+}
+
+int stats_hist_init(struct stats_hist *h, int sub_bits)
+{
+	memset(h, 0, sizeof(*h));
+	h->cnt = calloc(hist_num(sub_bits), sizeof(*h->cnt));
+	if (!h->cnt)
+		return -ENOMEM;
+
+	h->sub_bits = sub_bits;
+	return 0;
+}
+
+void stats_hist_free(struct stats_hist *h)
+{
+	free(h->cnt);
+	h->cnt = NULL;
+}
+
+/* drop all values, precision and memory are kept */
+void stats_hist_reset(struct stats_hist *h)
+{
+	if (h->cnt)
+		memset(h->cnt, 0, hist_num(h->sub_bits) * sizeof(*h->cnt));
+
+	h->num = 0;
+	h->min = 0;
+	h->max = 0;
+	h->sum = 0;
+}
+
+void stats_hist_add(struct stats_hist *h, __u64 val)
+{
+	if (!h->cnt)
+		return;
+
+	h->cnt[hist_idx(h, val)]++;
+	if (!h->num++ || val < h->min)
+		h->min = val;
+
+	if (val > h->max)
+		h->max = val;
+
+	h->sum += val;
+}
+
+/* histograms have to be of same precision */
+void stats_hist_merge(struct stats_hist *dst, struct stats_hist *src)
 {
-	return NSEC_PER_SEC * ts->tv_sec + ts->tv_nsec;
+	int i, num = hist_num(dst->sub_bits);
+
+	if (!src->num || !dst->cnt || src->sub_bits != dst->sub_bits)
+		return;
+
+	for (i = 0; i < num; i++)
+		dst->cnt[i] += src->cnt[i];
+
+	if (!dst->num || src->min < dst->min)
+		dst->min = src->min;
+
+	if (src->max > dst->max)
+		dst->max = src->max;
+
+	dst->num += src->num;
+	dst->sum += src->sum;
+}
+
+/* value below which pct percents of values are, 0 if no values */
+__u64 stats_hist_pct(struct stats_hist *h, double pct)
+{
+	int i, num = hist_num(h->sub_bits);
+	__u64 rank, sum = 0;
+
+	if (!h->num)
+		return 0;
+
+	rank = ceil(h->num * pct / 100);
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < num; i++) {
+		sum += h->cnt[i];
+		if (sum >= rank)
+			break;
+	}
+
+	/* bucket middle can't be out of values range */
+	if (i == num || hist_val(h, i) > h->max)
+		return h->max;
+
+	return hist_val(h, i) < h->min ? h->min : hist_val(h, i);
+}
+
+/* percentiles of latency SLOs, in us */
+void stats_hist_pct_print(struct stats_hist *h)
+{
+	printf("p50/p90/p99/p99.9/p99.99/max = %.2f/%.2f/%.2f/%.2f/%.2f/%.2f "
+	       "us\n", stats_hist_pct(h, 50) / 1000.0,
+	       stats_hist_pct(h, 90) / 1000.0, stats_hist_pct(h, 99) / 1000.0,
+	       stats_hist_pct(h, 99.9) / 1000.0,
+	       stats_hist_pct(h, 99.99) / 1000.0, h->max / 1000.0);
+}
+
+/* summary of values w/o vector they are taken from */
+int stats_hist_print(char *str, struct stats_hist *h)
+{
+	if (!h->num)
+		return 0;
+
+	printf("%s: packets %llu:\n", str, h->num);
+	printf("min = %.2fus, max = %.2fus, mean = %.2fus\n", h->min / 1000.0,
+	       h->max / 1000.0, h->sum / h->num / 1000.0);
+	stats_hist_pct_print(h);
+	printf("\n");
+	return h->num;
 }
 
 void stats_push(struct stats *ss, struct timespec *ts)
 {
-	ss->next_ts->tv_sec = ts->tv_sec;
-	ss->next_ts->tv_nsec = ts->tv_nsec;
-	ss->next_ts++;
+	if (stat_num(ss) >= ss->num)
+		return;
+
+	*ss->next_ts++ = ts_ns(ts);
 }
 
-void stats_push_id(struct stats *ss, struct timespec *ts, __u32 id)
+/* put ns at place of id, skipped entries stay zeroed */
+void stats_push_ns_id(struct stats *ss, __u64 ns, __u32 id)
 {
+	if (id >= ss->num)
+		return;
+
 	if (id == ss->id) {
-		ss->next_ts->tv_sec = ts->tv_sec;
-		ss->next_ts->tv_nsec = ts->tv_nsec;
-		ss->next_ts++;
+		*ss->next_ts++ = ns;
 		ss->id++;
 		return;
 	}
 
 	if (id > ss->id) {
 		ss->id = id + 1;
-		ss->next_ts += id - ss->id + 1;
+		ss->next_ts = ss->start_ts + ss->id;
 	}
 
-	(ss->start_ts + id)->tv_sec = ts->tv_sec;
-	(ss->start_ts + id)->tv_nsec = ts->tv_nsec;
+	ss->start_ts[id] = ns;
+}
+
+void stats_push_id(struct stats *ss, struct timespec *ts, __u32 id)
+{
+	stats_push_ns_id(ss, ts_ns(ts), id);
+}
+
+/* drop entries of ids not set in mask, order of others is kept */
+void stats_compact(struct stats *ss, const __u8 *mask)
+{
+	__u64 *ts = ss->start_ts;
+	__u32 id, num = stat_num(ss);
+
+	for (id = 0; id < num; id++) {
+		if (mask[id])
+			*ts++ = ss->start_ts[id];
+	}
+
+	ss->next_ts = ts;
+	ss->id = stat_num(ss);
 }
 
 int stats_correct_id(struct stats *ss, __u32 id)
 {
-	return ts_correct(ss->start_ts + id);
+	return id < ss->num && ss->start_ts[id];
 }
 
-static double stats_mean(struct stats *ss)
+/* gap of first entry has no previous one, so it's not counted */
+static inline __u64 stats_val(struct stats *ss, __u64 *ts, int flags)
 {
-	struct timespec *ts;
-	double mean = 0;
-	__u64 val;
-	__u64 n;
+	if (!(flags & STATS_GAP_DATA))
+		return *ts;
 
-	n = stat_num(ss);
-	for (ts = ss->start_ts; ts < ss->next_ts; ts++) {
-		val = to_val(ts);
-		mean += val / (n * 1000.0);
+	return ts > ss->start_ts ? *ts - *(ts - 1) : 0;
+}
+
+/*
+ * Min, max and sum of entries or of gaps between them, indexes are of
+ * entries, returns number of values.
+ */
+static __u64 stats_sum(struct stats *ss, int flags, struct vec_sum *sum)
+{
+	int gap = !!(flags & STATS_GAP_DATA);
+	__u64 n = stat_num(ss);
+
+	vec_sum(ss->start_ts, n, gap, sum);
+	if (!gap)
+		return n;
+
+	sum->min_n++;
+	sum->max_n++;
+	return n ? n - 1 : 0;
+}
+
+/* mean of entries or of gaps between them in us, 0 if there are no ones */
+double stats_avg(struct stats *ss, int flags)
+{
+	struct vec_sum sum;
+	__u64 num;
+
+	if (!stat_num(ss) || !*ss->start_ts)
+		return 0;
+
+	num = stats_sum(ss, flags, &sum);
+	return num ? sum.sum / 1000.0 / num : 0;
+}
+
+/* res = a - b, up to first entry that is not correct in one of them */
+void stats_diff(struct stats *a, struct stats *b, struct stats *res)
+{
+	__u64 n = stat_num(a) < stat_num(b) ? stat_num(a) : stat_num(b);
+
+	res->next_ts = res->start_ts;
+	res->next_ts += vec_diff(res->start_ts, a->start_ts, b->start_ts, n);
+}
+
+/*
+ * Units of job are taken by threads in any order. First a - b of every
+ * stage is put to its buffer, unit per stage, then values of all stages
+ * are reduced by chunks, chunks of one stage are units in a row.
+ */
+struct stats_job {
+	struct stats_stage *st;
+	int st_num;
+	int unit_num;
+	int next;		/* next unit to take */
+	int reduce;		/* units are chunks, not diffs */
+};
+
+/* histogram of stage worker is at, it's merged when worker leaves stage */
+struct stats_worker {
+	struct stats_hist h;
+	struct stats_stage *st;
+	pthread_t thd;
+};
+
+/*
+ * Workers are started once, with first job of more than one unit, and
+ * wait for next job, so threads are not created per print. Caller takes
+ * units of job as well.
+ */
+struct stats_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	pthread_mutex_t hist_lock;	/* stage histograms and errors */
+	struct stats_job *job;
+	unsigned long gen;	/* number of posted jobs */
+	int busy;		/* workers not done with job yet */
+	int started;
+	int thd_num;
+	struct stats_worker workers[STATS_THREAD_MAX];
+};
+
+static struct stats_pool pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+	.hist_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* number of values of stage, gaps are one less than entries */
+static __u64 stats_stage_num(struct stats_stage *st)
+{
+	__u64 n = stat_num(&st->ss);
+	int gap = !!(st->flags & STATS_GAP_DATA);
+
+	if (st->flags & STATS_LIN_DATA || !n || !*st->ss.start_ts)
+		return 0;
+
+	return n - gap;
+}
+
+/*
+ * Chunk summary: min, max and sum by simd kernel, then deviation from
+ * mean of chunk and histogram in one scalar pass.
+ */
+static void stats_part_sum(struct stats_stage *st, int i,
+			   struct stats_hist *h)
+{
+	int gap = !!(st->flags & STATS_GAP_DATA);
+	__u64 first = (__u64)i * STATS_CHUNK;
+	__u64 num = stats_stage_num(st) - first;
+	struct stats_part *p = &st->parts[i];
+	__u64 *ts, *end, val;
+	double mean, d;
+
+	if (num > STATS_CHUNK)
+		num = STATS_CHUNK;
+
+	ts = st->ss.start_ts + first;
+	vec_sum(ts, num + gap, gap, &p->sum);
+	p->sum.min_n += first + gap;
+	p->sum.max_n += first + gap;
+	p->num = num;
+	p->m2 = 0;
+
+	mean = (double)p->sum.sum / num;
+	for (ts += gap, end = ts + num; ts < end; ts++) {
+		val = stats_val(&st->ss, ts, st->flags);
+		d = val - mean;
+		p->m2 += d * d;
+		stats_hist_add(h, val);
 	}
+}
 
-	return mean;
+static void stats_stage_diff(struct stats_stage *st)
+{
+	if (st->b && st->ss.start_ts)
+		stats_diff(st->a, st->b, &st->ss);
 }
 
-static double stats_gap_mean(struct stats *ss)
+/* histogram of worker is added to stage it has done chunks of */
+static void stats_worker_leave(struct stats_worker *w)
 {
-	struct timespec *ts, temp;
-	double mean = 0;
-	__u64 n;
+	if (!w->st)
+		return;
 
-	n = stat_num(ss);
-	for (ts = ss->start_ts + 1; ts < ss->next_ts; ts++) {
-		ts_sub(ts, ts - 1, &temp);
-		mean += to_val(&temp) / ((n - 1) * 1000.0);
+	if (w->h.num) {
+		pthread_mutex_lock(&pool.hist_lock);
+		stats_hist_merge(&w->st->h, &w->h);
+		pthread_mutex_unlock(&pool.hist_lock);
+		stats_hist_reset(&w->h);
 	}
 
-	return mean;
+	w->st = NULL;
 }
 
-static double stats_gap_dev(struct stats *ss, double mean)
+static struct stats_hist *stats_worker_hist(struct stats_worker *w,
+					    struct stats_stage *st)
 {
-	struct timespec *ts, temp;
-	double dev = 0;
-	double mdif;
-	__u64 n;
+	static struct stats_hist none;
+	int err = 0;
 
-	n = stat_num(ss);
-	for (ts = ss->start_ts + 1; ts < ss->next_ts; ts++) {
-		ts_sub(ts, ts - 1, &temp);
-		mdif = mean - to_val(&temp) / 1000.0;
-		mdif *= mdif;
-		dev += mdif / (n - 1);
+	if (w->st != st) {
+		stats_worker_leave(w);
+		w->st = st;
 	}
 
-	dev = sqrt(dev);
-	return dev;
+	if (!st->h.cnt)
+		return &none;
+
+	if (!w->h.cnt || w->h.sub_bits != st->h.sub_bits) {
+		stats_hist_free(&w->h);
+		err = stats_hist_init(&w->h, st->h.sub_bits);
+	}
+
+	if (!err)
+		return &w->h;
+
+	pthread_mutex_lock(&pool.hist_lock);
+	st->err = err;
+	pthread_mutex_unlock(&pool.hist_lock);
+	return &none;
 }
 
-static double stats_dev(struct stats *ss, double mean)
+static void stats_job_run(struct stats_job *job, struct stats_worker *w)
 {
-	struct timespec *ts;
-	double dev = 0;
-	double mdif;
-	__u64 n;
+	struct stats_stage *st;
+	struct stats_hist *h;
+	int i, s = 0;
+
+	while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+	       job->unit_num) {
+		if (!job->reduce) {
+			stats_stage_diff(&job->st[i]);
+			continue;
+		}
 
-	n = stat_num(ss);
-	for (ts = ss->start_ts; ts < ss->next_ts; ts++) {
-		mdif = mean - to_val(ts) / 1000.0;
-		mdif *= mdif;
-		dev += mdif / n;
+		while (i >= job->st[s].first_part + job->st[s].part_num)
+			s++;
+
+		st = &job->st[s];
+		h = stats_worker_hist(w, st);
+		stats_part_sum(st, i - st->first_part, h);
 	}
 
-	dev = sqrt(dev);
-	return dev;
+	stats_worker_leave(w);
 }
 
-void stats_diff(struct stats *a, struct stats *b, struct stats *res)
+static void *stats_worker_run(void *arg)
 {
-	struct timespec *tsa, *tsb;
+	struct stats_worker *w = arg;
+	struct stats_job *job;
+	unsigned long gen = 0;
 
-	tsa = a->start_ts;
-	tsb = b->start_ts;
-	res->next_ts = res->start_ts;
+	pthread_mutex_lock(&pool.lock);
+	for (;;) {
+		while (pool.gen == gen)
+			pthread_cond_wait(&pool.work, &pool.lock);
+
+		gen = pool.gen;
+		job = pool.job;
+		pthread_mutex_unlock(&pool.lock);
+
+		stats_job_run(job, w);
+
+		pthread_mutex_lock(&pool.lock);
+		if (!--pool.busy)
+			pthread_cond_signal(&pool.done);
+	}
+
+	return NULL;
+}
 
-	while (tsa < a->next_ts && tsb < b->next_ts) {
-		if (ts_correct(tsa) && ts_correct(tsb)) {
-			ts_sub(tsa++, tsb++, res->next_ts++);
-		} else
+/* caller is one of threads, so pool w/o workers is fine as well */
+static void stats_pool_start(void)
+{
+	int i, num;
+
+	pool.started = 1;
+	num = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	if (num > STATS_THREAD_MAX)
+		num = STATS_THREAD_MAX;
+
+	for (i = 0; i < num; i++) {
+		if (pthread_create(&pool.workers[i].thd, NULL,
+				   stats_worker_run, &pool.workers[i]))
 			break;
+
+		pool.thd_num++;
+	}
+}
+
+/* job is done by caller and all workers, one unit is done by caller only */
+static void stats_pool_run(struct stats_job *job)
+{
+	struct stats_worker self = {0};
+
+	if (job->unit_num > 1 && !pool.started)
+		stats_pool_start();
+
+	if (job->unit_num > 1 && pool.thd_num) {
+		pthread_mutex_lock(&pool.lock);
+		pool.job = job;
+		pool.busy = pool.thd_num;
+		pool.gen++;
+		pthread_cond_broadcast(&pool.work);
+		pthread_mutex_unlock(&pool.lock);
+	}
+
+	stats_job_run(job, &self);
+	stats_hist_free(&self.h);
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.busy)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/* partial summaries are merged in order, so result doesn't depend on cpus */
+static void stats_part_merge(struct stats_part *dst, struct stats_part *p)
+{
+	double delta, num = dst->num + p->num;
+
+	delta = (double)p->sum.sum / p->num - (double)dst->sum.sum / dst->num;
+	dst->m2 += p->m2 + delta * delta * dst->num * p->num / num;
+	dst->num += p->num;
+	dst->sum.sum += p->sum.sum;
+
+	if (p->sum.min < dst->sum.min) {
+		dst->sum.min = p->sum.min;
+		dst->sum.min_n = p->sum.min_n;
+	}
+
+	if (p->sum.max > dst->sum.max) {
+		dst->sum.max = p->sum.max;
+		dst->sum.max_n = p->sum.max_n;
 	}
 }
 
-static void stats_print_log(struct stats *ss, int flags, struct timespec *rtime)
+/* stage of vector a, or of a - b if b is set, see stats_stages_run() */
+void stats_stage(struct stats_stage *st, char *str, struct stats *a,
+		 struct stats *b, int flags, __u64 *rtime)
+{
+	memset(st, 0, sizeof(*st));
+	st->str = str;
+	st->a = a;
+	st->b = b;
+	st->flags = rtime ? flags | STATS_LIN_DATA : flags;
+	st->rtime = rtime;
+}
+
+/* own buffer for a - b, and histogram if values are summarized */
+static void stats_stage_init(struct stats_stage *st)
+{
+	__u64 n = stat_num(st->a);
+
+	st->ss = *st->a;
+	if (st->b) {
+		if (stat_num(st->b) < n)
+			n = stat_num(st->b);
+
+		st->ss.start_ts = n ? malloc(n * sizeof(*st->ss.start_ts)) :
+				      NULL;
+		st->ss.next_ts = st->ss.start_ts;
+		st->ss.num = n;
+		if (n && !st->ss.start_ts)
+			st->err = -ENOMEM;
+	}
+
+	/* w/o memory for histogram only percentiles are not printed */
+	if (st->flags & STATS_LIN_DATA ||
+	    stats_hist_init(&st->h, plget->hist_bits))
+		memset(&st->h, 0, sizeof(st->h));
+}
+
+/*
+ * Summary, variance and histogram of every stage, stages are put to own
+ * buffers and reduced concurrently by thread pool, long vectors by chunks.
+ */
+void stats_stages_run(struct stats_stage *st, int num)
+{
+	struct stats_job job = {0};
+	int i, j;
+
+	for (i = 0; i < num; i++)
+		stats_stage_init(&st[i]);
+
+	job.st = st;
+	job.st_num = num;
+	job.unit_num = num;
+	stats_pool_run(&job);
+
+	job.unit_num = 0;
+	for (i = 0; i < num; i++) {
+		st[i].part_num = (stats_stage_num(&st[i]) + STATS_CHUNK - 1) /
+				 STATS_CHUNK;
+		st[i].first_part = job.unit_num;
+		if (st[i].part_num == 1) {
+			st[i].parts = &st[i].sum;
+		} else if (st[i].part_num) {
+			st[i].parts = calloc(st[i].part_num,
+					     sizeof(*st[i].parts));
+			if (!st[i].parts) {
+				st[i].err = -ENOMEM;
+				st[i].part_num = 0;
+			}
+		}
+
+		job.unit_num += st[i].part_num;
+	}
+
+	job.next = 0;
+	job.reduce = 1;
+	stats_pool_run(&job);
+
+	for (i = 0; i < num; i++) {
+		if (st[i].part_num <= 1)
+			continue;
+
+		st[i].sum = st[i].parts[0];
+		for (j = 1; j < st[i].part_num; j++)
+			stats_part_merge(&st[i].sum, &st[i].parts[j]);
+
+		free(st[i].parts);
+	}
+}
+
+static void stats_print_log(struct stats *ss, int flags, __u64 *rtime)
 {
-	double min_val = 1000000, max_val = 0;
-	struct timespec *ts, temp;
 	char line[LOG_LINE_SIZE];
-	int max_n = 0, min_n = 0;
-	__u64 n, start;
+	__u64 *ts, ns;
 	double val;
 	int pad;
 
 	if (flags & STATS_LIN_DATA) {
-		start = to_val(rtime);
-		printf("relative abs time %llu ns\n", start);
-		start = to_val(ss->start_ts);
-		printf("first packet abs time %llu ns\n", start);
+		printf("relative abs time %llu ns\n", *rtime);
+		printf("first packet abs time %llu ns\n", *ss->start_ts);
 	}
 
 	memset(line, '-', LOG_LINE_SIZE - 1);
@@ -195,21 +682,10 @@ static void stats_print_log(struct stats *ss, int flags, struct timespec *rtime)
 	if (flags & STATS_PLAIN_OUTPUT)
 		printf("\n");
 
-	n = stat_num(ss);
 	for (ts = ss->start_ts; ts < ss->next_ts; ts++) {
-		if (flags & STATS_LIN_DATA) {
-			ts_sub(ts, rtime, &temp);
-			val = to_val(&temp) / 1000.0;
-		} else if (flags & STATS_GAP_DATA) {
-			if (!to_num(ss, ts)) {
-				val = 0;
-			} else {
-				ts_sub(ts, ts - 1, &temp);
-				val = to_val(&temp) / 1000.0;
-			}
-		} else {
-			val = to_val(ts) / 1000.0;
-		}
+		ns = flags & STATS_LIN_DATA ? *ts - *rtime :
+					      stats_val(ss, ts, flags);
+		val = ns / 1000.0;
 
 		if (flags & STATS_PLAIN_OUTPUT)
 			printf("%g\n", val);
@@ -219,24 +695,6 @@ static void stats_print_log(struct stats *ss, int flags, struct timespec *rtime)
 
 			printf(" %*g |", LOG_ENTRY_SIZE - 3, val);
 		}
-
-		if (flags & STATS_GAP_DATA) {
-			if (!to_num(ss, ts)) {
-				if (n == 1)
-					min_val = 0;
-				continue;
-			}
-		}
-
-		if (max_val < val) {
-			max_n = to_num(ss, ts);
-			max_val = val;
-		}
-
-		if (min_val > val) {
-			min_n = to_num(ss, ts);
-			min_val = val;
-		}
 	}
 
 	int pad_needed = !(flags & STATS_PLAIN_OUTPUT) &&
@@ -247,35 +705,42 @@ static void stats_print_log(struct stats *ss, int flags, struct timespec *rtime)
 	}
 
 	printf("\n%s\n", line);
-
-	if (flags & STATS_LIN_DATA)
-		return;
-
-	printf("max val(#%d) = %.2fus\n", max_n, max_val);
-	printf("min val(#%d) = %.2fus\n", min_n, min_val);
-	printf("peak-to-peak = %.2fus\n", max_val - min_val);
 }
 
 int stats_reserve(struct stats *ss, int entry_num)
 {
-	struct timespec *ts;
+	__u64 *ts;
 
-	ts = malloc(entry_num * sizeof(*ts));
+	/* zeroed, as ids that are not received leave holes */
+	ts = calloc(entry_num, sizeof(*ts));
 	if (ts == NULL)
 		return -1;
 
 	ss->start_ts = ts;
 	ss->next_ts = ts;
+	ss->num = entry_num;
 
 	return 0;
 }
 
-void stats_drate_print(struct timespec *interval, int pkt_num, int data_size)
+/* drop all entries, reserved memory is kept */
+void stats_reset(struct stats *ss)
+{
+	if (!ss->start_ts)
+		return;
+
+	memset(ss->start_ts, 0, ss->num * sizeof(*ss->start_ts));
+	ss->next_ts = ss->start_ts;
+	ss->id = 0;
+}
+
+void stats_drate_print(struct timespec *interval, int pkt_num,
+		       __u64 data_size)
 {
 	__u64 val;
 	double rate, pps, period;
 
-	val = to_val(interval);
+	val = ts_ns(interval);
 	pps = (double)pkt_num * NSEC_PER_SEC / val;
 	rate = (double)data_size * 8 * USEC_PER_SEC / val;
 	period = val / (double)pkt_num;
@@ -286,9 +751,9 @@ void stats_drate_print(struct timespec *interval, int pkt_num, int data_size)
 
 void stats_rate_print(struct timespec *interval, int pkt_num, int frame_size)
 {
-	int dsize;
+	__u64 dsize;
 
-	dsize = frame_size * pkt_num;
+	dsize = (__u64)frame_size * pkt_num;
 	stats_drate_print(interval, pkt_num, dsize);
 }
 
@@ -296,45 +761,70 @@ void stats_vrate_print(struct stats *ss, int frame_size)
 {
 	struct timespec interval;
 	unsigned int pkt_num;
+	__u64 ns;
 
 	pkt_num = ss->next_ts - ss->start_ts;
-	if (pkt_num-- < 2 || !ts_correct(ss->start_ts))
+	if (pkt_num-- < 2 || !*ss->start_ts)
 		return;
 
-	ts_sub(ss->next_ts - 1, ss->start_ts, &interval);
+	ns = *(ss->next_ts - 1) - *ss->start_ts;
+	interval.tv_sec = ns / NSEC_PER_SEC;
+	interval.tv_nsec = ns % NSEC_PER_SEC;
 	stats_rate_print(&interval, pkt_num, frame_size);
 }
 
-int stats_print(char *str, struct stats *ss, int flags, struct timespec *rtime)
+/* stage is printed once stats_stages_run() is done, its buffers are freed */
+int stats_stage_print(struct stats_stage *st)
 {
-	double mean, dev;
-	__u64 n;
+	struct stats_part *sum = &st->sum;
+	struct stats *ss = &st->ss;
+	double mean;
+	__u64 n = 0;
+
+	printf("%s", st->hdr);
+	if (!ss->start_ts && st->err) {
+		printf("%s: cannot allocate values\n\n", st->str);
+		goto free;
+	}
 
 	/* don't print if first entry is incorrect or no entries */
-	n = stat_num(ss);
-	if (!n || !ts_correct(ss->start_ts))
-		return 0;
-
-	printf("%s: packets %llu:\n", str, n);
+	n = ss->start_ts ? stat_num(ss) : 0;
+	if (!n || !*ss->start_ts)
+		goto free;
 
-	if (rtime)
-		flags |= STATS_LIN_DATA;
+	printf("%s: packets %llu:\n", st->str, n);
+	stats_print_log(ss, st->flags, st->rtime);
 
-	stats_print_log(ss, flags, rtime);
-
-	if (flags & STATS_LIN_DATA)
+	if (st->flags & STATS_LIN_DATA)
 		goto out;
 
-	if (flags & STATS_GAP_DATA) {
-		mean = stats_gap_mean(ss);
-		dev = stats_gap_dev(ss, mean);
-	} else {
-		mean = stats_mean(ss);
-		dev = stats_dev(ss, mean);
-	}
-
-	printf("mean +- RMS = %.2f +- %.2f us\n", mean, dev);
+	mean = sum->num ? (double)sum->sum.sum / sum->num : 0;
+	printf("max val(#%zu) = %.2fus\n", sum->sum.max_n,
+	       sum->sum.max / 1000.0);
+	printf("min val(#%zu) = %.2fus\n", sum->sum.min_n,
+	       sum->sum.min / 1000.0);
+	printf("peak-to-peak = %.2fus\n",
+	       (sum->sum.max - sum->sum.min) / 1000.0);
+	printf("mean +- RMS = %.2f +- %.2f us\n", mean / 1000.0,
+	       sum->num ? sqrt(sum->m2 / sum->num) / 1000.0 : 0);
+
+	if (!st->err && st->h.num)
+		stats_hist_pct_print(&st->h);
 out:
 	printf("\n");
+free:
+	if (st->b)
+		free(ss->start_ts);
+
+	stats_hist_free(&st->h);
 	return n;
 }
+
+int stats_print(char *str, struct stats *ss, int flags, __u64 *rtime)
+{
+	struct stats_stage st;
+
+	stats_stage(&st, str, ss, NULL, flags, rtime);
+	stats_stages_run(&st, 1);
+	return stats_stage_print(&st);
+}
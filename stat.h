@@ -14,6 +14,7 @@
 
 #include <time.h>
 #include <linux/types.h>
+#include "vec.h"
 
 #define STATS_PLAIN_OUTPUT	0x01
 #define STATS_LIN_DATA		0x02
@@ -22,22 +23,96 @@
 #ifndef LAT_STAT_H
 #define LAT_STAT_H
 
+/* entries are ns, zero one is not correct, e.g. hole of lost packet */
 struct stats {
-	struct timespec *next_ts;
-	struct timespec *start_ts;
+	__u64 *next_ts;
+	__u64 *start_ts;
 	__u32 id;
+	__u32 num;		/* number of reserved entries */
+};
+
+/* timespecs of kernel are converted once, when ts is pushed */
+static inline __u64 ts_ns(struct timespec *ts)
+{
+	return (__u64)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/* significant digits of histogram values by default, see -H */
+#define STATS_HIST_DIGITS	2
+#define STATS_HIST_DIGITS_MAX	3
+
+/*
+ * HDR histogram, log2 buckets with 2^sub_bits linear sub-buckets each, so
+ * relative error of value is 2^-sub_bits whatever the value is. Value is
+ * added in O(1), memory doesn't depend on number of values. Histogram w/o
+ * counters is off, values are not added to it.
+ */
+struct stats_hist {
+	__u64 *cnt;
+	__u64 num;
+	__u64 min;
+	__u64 max;
+	double sum;
+	int sub_bits;
+};
+
+/* summary of chunk of values, or of whole vector once chunks are merged */
+struct stats_part {
+	struct vec_sum sum;
+	__u64 num;
+	double m2;		/* sum of squared differences from its mean */
+};
+
+/*
+ * Vector printed by post-run analysis, a - b is put to own buffer of stage
+ * if b is set. Stages are reduced concurrently by stats_stages_run() and
+ * printed in order by stats_stage_print() then.
+ */
+struct stats_stage {
+	char hdr[48];		/* printed before stage even w/o entries */
+	char *str;
+	struct stats *a;
+	struct stats *b;
+	struct stats ss;	/* a or a - b */
+	__u64 *rtime;
+	int flags;
+	int err;
+	struct stats_part sum;
+	struct stats_hist h;
+	struct stats_part *parts;
+	int part_num;
+	int first_part;		/* first chunk of stage in all stages */
 };
 
 void ts_sub(struct timespec *a, struct timespec *b, struct timespec *res);
 void stats_push(struct stats *ss, struct timespec *ts);
 void stats_push_id(struct stats *ss, struct timespec *ts, __u32 id);
-int stats_print(char *str, struct stats *ss, int flags, struct timespec *rtime);
+void stats_push_ns_id(struct stats *ss, __u64 ns, __u32 id);
+int stats_print(char *str, struct stats *ss, int flags, __u64 *rtime);
+void stats_stage(struct stats_stage *st, char *str, struct stats *a,
+		 struct stats *b, int flags, __u64 *rtime);
+void stats_stages_run(struct stats_stage *st, int num);
+int stats_stage_print(struct stats_stage *st);
 int stats_reserve(struct stats *ss, int entry_num);
+void stats_reset(struct stats *ss);
 void stats_diff(struct stats *a, struct stats *b, struct stats *res);
 int stats_correct_id(struct stats *ss, __u32 id);
+void stats_compact(struct stats *ss, const __u8 *mask);
+double stats_avg(struct stats *ss, int flags);
+
+int stats_hist_bits(int digits);
+int stats_hist_init(struct stats_hist *h, int sub_bits);
+void stats_hist_free(struct stats_hist *h);
+void stats_hist_reset(struct stats_hist *h);
+void stats_hist_add(struct stats_hist *h, __u64 val);
+void stats_hist_merge(struct stats_hist *dst, struct stats_hist *src);
+__u64 stats_hist_pct(struct stats_hist *h, double pct);
+void stats_hist_pct_print(struct stats_hist *h);
+int stats_hist_print(char *str, struct stats_hist *h);
 
 void stats_vrate_print(struct stats *ss, int frame_size);
 void stats_rate_print(struct timespec *interval, int pkt_num, int frame_size);
-void stats_drate_print(struct timespec *interval, int pkt_num, int data_size);
+void stats_drate_print(struct timespec *interval, int pkt_num,
+		       __u64 data_size);
 
 #endif
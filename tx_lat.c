@@ -11,19 +11,31 @@
 #include "stat.h"
 #include "tx_lat.h"
 #include "xdp_sock.h"
+#include "uring.h"
+#include "pkt_parse.h"
+#include "pcap.h"
 #include <poll.h>
 #include <unistd.h>
 #include <errno.h>
 
 #define MAX_LATENCY			5000
-#define VLAN_TAG_SIZE			4
-#define MAC_ADDR_SIZE			6
 
 static int init_tx_test(void)
 {
+	int ret;
+
 	if (!ts_correct(&plget->interval))
 		plget->interval.tv_sec = 1;
 
+	if (plget->flags & PLF_URING) {
+		ret = uring_tx_setup(plget->sk_payload_size,
+				     (struct sockaddr *)&plget->sk_addr,
+				     plget->sk_addr_len,
+				     plget->pkt_type == PKT_UDP);
+		if (ret)
+			return ret;
+	}
+
 	return plget_create_timer();
 }
 
@@ -32,7 +44,8 @@ static int get_tx_tstamps(void)
 	struct scm_timestamping *tss = NULL;
 	struct msghdr *msg = &plget->msg;
 	struct sock_extended_err *serr;
-	int i, ts_type, psize;
+	int i, ts_type, psize, off;
+	struct pkt_hdrs hdrs;
 	struct cmsghdr *cmsg;
 	struct timespec *ts;
 	struct stats *v;
@@ -54,6 +67,8 @@ static int get_tx_tstamps(void)
 			continue;
 		} else if (!((cmsg->cmsg_level == SOL_IP &&
 			      cmsg->cmsg_type == IP_RECVERR) ||
+			     (cmsg->cmsg_level == SOL_IPV6 &&
+			      cmsg->cmsg_type == IPV6_RECVERR) ||
 			     (cmsg->cmsg_level == SOL_PACKET &&
 			      cmsg->cmsg_type == PACKET_TX_TIMESTAMP))) {
 			continue;
@@ -68,23 +83,22 @@ static int get_tx_tstamps(void)
 		ts_type = serr->ee_info;
 	}
 
+	/* looped frame has all headers, it can be tagged or tunneled */
+	if (parse_pkt(plget->data, psize, &hdrs))
+		return -1;
+
 	/* check MAGIC number and get timestamp id */
-	magic = magic_rd();
+	off = hdrs.off + plget->off_magic_pl;
+	if (off + PL_HLEN > psize)
+		return -1;
+
+	magic = plget->data + off;
 	if (*magic != MAGIC) {
-		/* can be vlan tagged packet */
-		if (*(plget->data + MAC_ADDR_SIZE * 2) == 0x81 &&
-		    *(plget->data + 1 + MAC_ADDR_SIZE * 2) == 0x00 &&
-		    *(magic + VLAN_TAG_SIZE) == MAGIC) {
-				/* don't do this next time */
-				plget->off_magic_rd += VLAN_TAG_SIZE;
-				plget->off_tid_rd += VLAN_TAG_SIZE;
-		} else {
-			printf("incorrect tx MAGIC number 0x%x\n", *magic);
-			return -1;
-		}
+		printf("incorrect tx MAGIC number 0x%x\n", *magic);
+		return -1;
 	}
 
-	ts_id = tid_rd();
+	ts_id = tid_rd(magic);
 
 	if (!tss)
 		return plget->mod == RTT_MOD ? 0 : -1;
@@ -102,6 +116,11 @@ static int get_tx_tstamps(void)
 		return -1;
 	}
 
+	/* frame is captured with every timestamp it's looped with */
+	if (plget->flags & PLF_CAPTURE_TX)
+		pcap_tx(plget->data, psize, ts_ns(ts), ts_ns(ts + 2),
+				ts_id);
+
 	if (ts_correct(ts))
 		stats_push_id(&tx_sw_v, ts, ts_id);
 	else
@@ -113,10 +132,15 @@ static int txlat_sendto(void)
 {
 	int ret;
 
+	if (plget->flags & PLF_URING) {
+		ret = uring_tx_send(plget->pkt, 1);
+		return ret ? ret : plget->sk_payload_size;
+	}
+
 	if (plget->pkt_type != PKT_XDP) {
 		ret = sendto(plget->sfd, plget->pkt, plget->sk_payload_size, 0,
 				(struct sockaddr *)&plget->sk_addr,
-				sizeof(plget->sk_addr));
+				plget->sk_addr_len);
 		return ret;
 	}
 
@@ -173,12 +197,19 @@ static int txlat_proc_packets(void)
 			if (plget->flags & PLF_PTP)
 				sid_wr(htons((tx_cnt & SEQ_ID_MASK) | sid));
 
+			/* sender ts is in payload, so it's taken before tid_wr */
+			if (plget->flags & PLF_TX_TS) {
+				clock_gettime(CLOCK_REALTIME, &ts);
+				tx_ts_wr(&ts);
+			}
+
 			tid_wr(tx_cnt);
 			if (++tx_cnt >= pkt_num)
 				plget_stop_timer();
 
 			/* send packet */
-			clock_gettime(CLOCK_REALTIME, &ts);
+			if (!(plget->flags & PLF_TX_TS))
+				clock_gettime(CLOCK_REALTIME, &ts);
 			ret = txlat_sendto();
 
 			stats_push(&tx_app_v, &ts);
@@ -264,6 +295,14 @@ int txlat(void)
 		return ret;
 
 	ret = txlat_proc_packets();
+	if (plget->flags & PLF_URING) {
+		if (!ret && uring_tx_flush()) {
+			perror("sendto");
+			ret = -errno;
+		}
+
+		uring_release();
+	}
 
 	close(plget->timer_fd);
 	return ret;
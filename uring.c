@@ -0,0 +1,642 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "uring.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#define URING_SQ_NUM		128
+/* multishot recv can post many cqes per one sqe */
+#define URING_CQ_NUM		1024
+#define URING_RX_BUF_NUM	256
+#define URING_RX_BUF_SIZE	4096
+#define URING_RX_BGID		0
+#define URING_RX_DATA		(~0ULL)
+/* sq poll thread goes to sleep after this idle time in ms */
+#define URING_SQ_IDLE		1000
+#define URING_TX_ALIGN		64
+
+#ifndef IORING_REGISTER_NAPI
+#define IORING_REGISTER_NAPI	27
+#endif
+
+/* argument for IORING_REGISTER_NAPI, dynamic tracking of napi ids */
+struct uring_napi {
+	__u32 busy_poll_to;
+	__u8 prefer_busy_poll;
+	__u8 pad[3];
+	__u64 resv;
+};
+
+struct uring {
+	int fd;
+	unsigned int setup_flags;
+	void *sq_map;
+	size_t sq_size;
+	void *cq_map;
+	size_t cq_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	/* sq ring */
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_flags;
+	unsigned int *sq_array;
+	unsigned int sq_entries;
+	unsigned int sqe_tail;		/* next sqe to be filled */
+	unsigned int sqe_head;		/* next sqe to be submitted */
+
+	/* cq ring */
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/* rx provided buffers */
+	struct io_uring_buf_ring *br;
+	size_t br_size;
+	unsigned short br_tail;
+	char *rx_bufs;
+	struct msghdr rx_msg;		/* layout of multishot recvmsg buffer */
+	int rx_bid;			/* buffer held by app, -1 if none */
+
+	/* tx registered buffers */
+	char *tx_bufs;
+	int tx_stride;
+	int tx_size;
+	struct sockaddr *tx_addr;
+	socklen_t tx_addrlen;
+	int tx_zc;
+	int tx_next;
+	int tx_inflight;
+	char tx_busy[URING_TX_NUM];
+};
+
+static __thread struct uring ur = { .fd = -1 };
+
+static int uring_enter(unsigned int to_submit, unsigned int min_complete,
+		       unsigned int flags)
+{
+	int ret;
+
+	ret = syscall(__NR_io_uring_enter, ur.fd, to_submit, min_complete,
+		      flags, NULL, 0);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static int uring_register(unsigned int opcode, void *arg, unsigned int num)
+{
+	int ret;
+
+	ret = syscall(__NR_io_uring_register, ur.fd, opcode, arg, num);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static struct io_uring_sqe *uring_get_sqe(void)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int head, idx;
+
+	head = __atomic_load_n(ur.sq_head, __ATOMIC_ACQUIRE);
+	if (ur.sqe_tail - head >= ur.sq_entries)
+		return NULL;
+
+	idx = ur.sqe_tail++ & *ur.sq_mask;
+	ur.sq_array[idx] = idx;
+	sqe = &ur.sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+
+	return sqe;
+}
+
+/*
+ * Pass filled sqes to kernel and wait for wait cqes. With sq poll thread
+ * kernel picks sqes itself, it only has to be woken up if it's asleep.
+ */
+static int uring_submit(unsigned int wait)
+{
+	unsigned int flags = 0, num;
+	int ret;
+
+	__atomic_store_n(ur.sq_tail, ur.sqe_tail, __ATOMIC_RELEASE);
+	num = ur.sqe_tail - ur.sqe_head;
+	ur.sqe_head = ur.sqe_tail;
+
+	if (wait)
+		flags |= IORING_ENTER_GETEVENTS;
+
+	if (ur.setup_flags & IORING_SETUP_SQPOLL) {
+		num = 0;
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(ur.sq_flags, __ATOMIC_RELAXED) &
+		    IORING_SQ_NEED_WAKEUP)
+			flags |= IORING_ENTER_SQ_WAKEUP;
+	}
+
+	if (!num && !flags)
+		return 0;
+
+	do
+		ret = uring_enter(num, wait, flags);
+	while (ret == -EINTR);
+
+	return ret;
+}
+
+static struct io_uring_cqe *uring_peek_cqe(void)
+{
+	unsigned int head = *ur.cq_head;
+
+	if (head == __atomic_load_n(ur.cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	return &ur.cqes[head & *ur.cq_mask];
+}
+
+static void uring_cqe_seen(void)
+{
+	__atomic_store_n(ur.cq_head, *ur.cq_head + 1, __ATOMIC_RELEASE);
+}
+
+static int uring_map(struct io_uring_params *p)
+{
+	ur.sq_size = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+	ur.cq_size = p->cq_off.cqes +
+		     p->cq_entries * sizeof(struct io_uring_cqe);
+
+	/* sq and cq rings can share one mmap */
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		if (ur.cq_size > ur.sq_size)
+			ur.sq_size = ur.cq_size;
+
+		ur.cq_size = 0;
+	}
+
+	ur.sq_map = mmap(NULL, ur.sq_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_SQ_RING);
+	if (ur.sq_map == MAP_FAILED) {
+		ur.sq_map = NULL;
+		return -errno;
+	}
+
+	ur.cq_map = ur.sq_map;
+	if (ur.cq_size) {
+		ur.cq_map = mmap(NULL, ur.cq_size, PROT_READ | PROT_WRITE,
+				 MAP_SHARED | MAP_POPULATE, ur.fd,
+				 IORING_OFF_CQ_RING);
+		if (ur.cq_map == MAP_FAILED) {
+			ur.cq_map = NULL;
+			return -errno;
+		}
+	}
+
+	ur.sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	ur.sqes = mmap(NULL, ur.sqes_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_SQES);
+	if (ur.sqes == MAP_FAILED) {
+		ur.sqes = NULL;
+		return -errno;
+	}
+
+	ur.sq_head = ur.sq_map + p->sq_off.head;
+	ur.sq_tail = ur.sq_map + p->sq_off.tail;
+	ur.sq_mask = ur.sq_map + p->sq_off.ring_mask;
+	ur.sq_flags = ur.sq_map + p->sq_off.flags;
+	ur.sq_array = ur.sq_map + p->sq_off.array;
+	ur.sq_entries = p->sq_entries;
+
+	ur.cq_head = ur.cq_map + p->cq_off.head;
+	ur.cq_tail = ur.cq_map + p->cq_off.tail;
+	ur.cq_mask = ur.cq_map + p->cq_off.ring_mask;
+	ur.cqes = ur.cq_map + p->cq_off.cqes;
+
+	return 0;
+}
+
+int uring_setup(int sfd, int sqpoll)
+{
+	struct io_uring_params p;
+	int ret;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = URING_CQ_NUM;
+	if (sqpoll) {
+		p.flags |= IORING_SETUP_SQPOLL;
+		p.sq_thread_idle = URING_SQ_IDLE;
+	}
+
+	ur.fd = syscall(__NR_io_uring_setup, URING_SQ_NUM, &p);
+	if (ur.fd < 0)
+		return perror("Couldn't setup io_uring"), -errno;
+
+	ur.setup_flags = p.flags;
+	ur.sq_map = NULL;
+	ur.cq_map = NULL;
+	ur.sqes = NULL;
+	ur.sqe_tail = 0;
+	ur.sqe_head = 0;
+
+	ret = uring_map(&p);
+	if (ret) {
+		errno = -ret;
+		return perror("Couldn't mmap io_uring"), ret;
+	}
+
+	/* socket is referred as fixed file 0 */
+	ret = uring_register(IORING_REGISTER_FILES, &sfd, 1);
+	if (ret) {
+		errno = -ret;
+		return perror("Couldn't register io_uring file"), ret;
+	}
+
+	return 0;
+}
+
+int uring_fd(void)
+{
+	return ur.fd;
+}
+
+/* busy poll napi of socket instead of waiting for irq */
+int uring_napi_setup(int busy_poll_us)
+{
+	struct uring_napi napi;
+	int ret;
+
+	memset(&napi, 0, sizeof(napi));
+	napi.busy_poll_to = busy_poll_us;
+
+	ret = uring_register(IORING_REGISTER_NAPI, &napi, 1);
+	if (ret) {
+		errno = -ret;
+		return perror("Couldn't register io_uring napi"), ret;
+	}
+
+	return 0;
+}
+
+static void uring_rx_buf_add(int bid)
+{
+	struct io_uring_buf *buf;
+
+	buf = &ur.br->bufs[ur.br_tail & (URING_RX_BUF_NUM - 1)];
+	buf->addr = (unsigned long)(ur.rx_bufs + bid * URING_RX_BUF_SIZE);
+	buf->len = URING_RX_BUF_SIZE;
+	buf->bid = bid;
+
+	__atomic_store_n(&ur.br->tail, ++ur.br_tail, __ATOMIC_RELEASE);
+}
+
+/* multishot recvmsg is stopped on error or cq overflow, so it's rearmed */
+static int uring_rx_arm(void)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = uring_get_sqe();
+	if (!sqe)
+		return -EBUSY;
+
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = 0;
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->addr = (unsigned long)&ur.rx_msg;
+	sqe->len = 1;
+	sqe->buf_group = URING_RX_BGID;
+	sqe->user_data = URING_RX_DATA;
+
+	return uring_submit(0);
+}
+
+/*
+ * Every provided buffer is filled by kernel as io_uring_recvmsg_out,
+ * control of controllen size and payload then, there is no name.
+ */
+int uring_rx_setup(int controllen)
+{
+	struct io_uring_buf_reg reg;
+	int i, ret;
+
+	ur.br_size = URING_RX_BUF_NUM * sizeof(struct io_uring_buf);
+	ur.br = mmap(NULL, ur.br_size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ur.br == MAP_FAILED) {
+		ur.br = NULL;
+		return perror("Couldn't allocate buffer ring"), -errno;
+	}
+
+	ur.rx_bufs = malloc(URING_RX_BUF_NUM * URING_RX_BUF_SIZE);
+	if (!ur.rx_bufs)
+		return perror("Couldn't allocate rx buffers"), -ENOMEM;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (unsigned long)ur.br;
+	reg.ring_entries = URING_RX_BUF_NUM;
+	reg.bgid = URING_RX_BGID;
+	ret = uring_register(IORING_REGISTER_PBUF_RING, &reg, 1);
+	if (ret) {
+		errno = -ret;
+		return perror("Couldn't register buffer ring"), ret;
+	}
+
+	ur.br_tail = 0;
+	for (i = 0; i < URING_RX_BUF_NUM; i++)
+		uring_rx_buf_add(i);
+
+	memset(&ur.rx_msg, 0, sizeof(ur.rx_msg));
+	ur.rx_msg.msg_controllen = controllen;
+	ur.rx_bid = -1;
+
+	ret = uring_rx_arm();
+	if (ret < 0) {
+		errno = -ret;
+		return perror("Couldn't arm multishot recvmsg"), ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Wait for completion in kernel, in spin mode only flush overflown cqes if
+ * any, as it's done only while entering kernel. Returns -EINTR if wait is
+ * interrupted.
+ */
+int uring_rx_wait(int spin)
+{
+	int ret;
+
+	if (spin && !(__atomic_load_n(ur.sq_flags, __ATOMIC_RELAXED) &
+		      IORING_SQ_CQ_OVERFLOW))
+		return 0;
+
+	while (!uring_peek_cqe()) {
+		ret = uring_enter(0, !spin, IORING_ENTER_GETEVENTS);
+		if (ret == -EINTR)
+			return ret;
+
+		if (ret < 0) {
+			errno = -ret;
+			return perror("io_uring wait"), ret;
+		}
+
+		if (spin)
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * Get next received message w/o waiting, msg control and data point to
+ * provided buffer till uring_rx_done(). Returns size of data or -EAGAIN
+ * if nothing is received yet.
+ */
+int uring_rx_peek(struct msghdr *msg, char **data)
+{
+	struct io_uring_recvmsg_out *out;
+	struct io_uring_cqe *cqe;
+	unsigned int flags;
+	int res, ret;
+	char *buf;
+
+	for (;;) {
+		cqe = uring_peek_cqe();
+		if (!cqe)
+			return -EAGAIN;
+
+		res = cqe->res;
+		flags = cqe->flags;
+		uring_cqe_seen();
+
+		if (!(flags & IORING_CQE_F_MORE)) {
+			ret = uring_rx_arm();
+			if (ret < 0) {
+				errno = -ret;
+				return perror("Couldn't rearm recvmsg"), ret;
+			}
+		}
+
+		/* all buffers are in use, packet is dropped */
+		if (res == -ENOBUFS)
+			continue;
+
+		if (res < 0) {
+			errno = -res;
+			return perror("io_uring recvmsg"), res;
+		}
+
+		if (flags & IORING_CQE_F_BUFFER)
+			break;
+	}
+
+	ur.rx_bid = flags >> IORING_CQE_BUFFER_SHIFT;
+	buf = ur.rx_bufs + ur.rx_bid * URING_RX_BUF_SIZE;
+	out = (struct io_uring_recvmsg_out *)buf;
+
+	/* name and control areas are of template sizes, whatever is filled */
+	msg->msg_control = buf + sizeof(*out) + ur.rx_msg.msg_namelen;
+	msg->msg_controllen = out->controllen;
+	msg->msg_flags = out->flags;
+	*data = (char *)msg->msg_control + ur.rx_msg.msg_controllen;
+
+	return res - (*data - buf);
+}
+
+/* give buffer of last message back to kernel */
+void uring_rx_done(void)
+{
+	if (ur.rx_bid < 0)
+		return;
+
+	uring_rx_buf_add(ur.rx_bid);
+	ur.rx_bid = -1;
+}
+
+/*
+ * Packets are copied to tx buffers registered once, every buffer is busy
+ * till last cqe of its send. Zero copy send posts extra notification cqe
+ * when buffer is released by stack.
+ */
+int uring_tx_setup(int size, struct sockaddr *addr, socklen_t addrlen,
+		   int zc)
+{
+	struct iovec iov;
+	int ret;
+
+	ur.tx_stride = (size + URING_TX_ALIGN - 1) & ~(URING_TX_ALIGN - 1);
+	iov.iov_len = (size_t)URING_TX_NUM * ur.tx_stride;
+	iov.iov_base = mmap(NULL, iov.iov_len, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (iov.iov_base == MAP_FAILED)
+		return perror("Couldn't allocate tx buffers"), -errno;
+
+	ur.tx_bufs = iov.iov_base;
+	ret = uring_register(IORING_REGISTER_BUFFERS, &iov, 1);
+	if (ret) {
+		errno = -ret;
+		return perror("Couldn't register tx buffers"), ret;
+	}
+
+	ur.tx_size = size;
+	ur.tx_addr = addr;
+	ur.tx_addrlen = addrlen;
+	ur.tx_zc = zc;
+	ur.tx_next = 0;
+	ur.tx_inflight = 0;
+	memset(ur.tx_busy, 0, sizeof(ur.tx_busy));
+
+	return 0;
+}
+
+/* reap tx completions, wait for one at least if wait is set */
+static int uring_tx_reap(int wait)
+{
+	struct io_uring_cqe *cqe;
+	int ret = 0, res;
+
+	if (wait && !uring_peek_cqe()) {
+		res = uring_submit(1);
+		if (res < 0) {
+			ret = res;
+			goto out;
+		}
+	}
+
+	while ((cqe = uring_peek_cqe())) {
+		res = cqe->res;
+		if (!(cqe->flags & IORING_CQE_F_NOTIF) && res != ur.tx_size)
+			ret = res < 0 ? res : -EMSGSIZE;
+
+		if (!(cqe->flags & IORING_CQE_F_MORE)) {
+			ur.tx_busy[cqe->user_data] = 0;
+			ur.tx_inflight--;
+		}
+
+		uring_cqe_seen();
+	}
+
+out:
+	if (ret)
+		errno = -ret;
+
+	return ret;
+}
+
+/*
+ * Queue packet to send, submit queued ones if submit is set. Errors of
+ * sends are reported by later calls, errno is set then.
+ */
+int uring_tx_send(const char *pkt, int submit)
+{
+	struct io_uring_sqe *sqe;
+	int ret, idx = ur.tx_next;
+	char *buf;
+
+	while (ur.tx_busy[idx]) {
+		ret = uring_tx_reap(1);
+		if (ret)
+			return ret;
+	}
+
+	buf = ur.tx_bufs + idx * ur.tx_stride;
+	memcpy(buf, pkt, ur.tx_size);
+
+	sqe = uring_get_sqe();
+	if (!sqe)
+		return errno = EBUSY, -EBUSY;
+
+	/* registered buffer is taken only by zc send, no zc for packet socket */
+	if (ur.tx_zc) {
+		sqe->opcode = IORING_OP_SEND_ZC;
+		sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+		sqe->buf_index = 0;
+	} else {
+		sqe->opcode = IORING_OP_SEND;
+	}
+
+	sqe->fd = 0;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->addr = (unsigned long)buf;
+	sqe->len = ur.tx_size;
+	sqe->addr2 = (unsigned long)ur.tx_addr;
+	sqe->addr_len = ur.tx_addrlen;
+	sqe->user_data = idx;
+
+	ur.tx_busy[idx] = 1;
+	ur.tx_inflight++;
+	ur.tx_next = (idx + 1) % URING_TX_NUM;
+
+	if (!submit)
+		return 0;
+
+	ret = uring_submit(0);
+	if (ret < 0)
+		return errno = -ret, ret;
+
+	return uring_tx_reap(0);
+}
+
+/* submit queued packets and wait till all of them are sent */
+int uring_tx_flush(void)
+{
+	int ret = 0;
+
+	while (ur.tx_inflight && !ret)
+		ret = uring_tx_reap(1);
+
+	return ret;
+}
+
+void uring_release(void)
+{
+	if (ur.fd < 0)
+		return;
+
+	close(ur.fd);
+	ur.fd = -1;
+
+	if (ur.sqes)
+		munmap(ur.sqes, ur.sqes_size);
+
+	if (ur.cq_map && ur.cq_size)
+		munmap(ur.cq_map, ur.cq_size);
+
+	if (ur.sq_map)
+		munmap(ur.sq_map, ur.sq_size);
+
+	if (ur.br) {
+		munmap(ur.br, ur.br_size);
+		ur.br = NULL;
+	}
+
+	free(ur.rx_bufs);
+	ur.rx_bufs = NULL;
+
+	if (ur.tx_bufs) {
+		munmap(ur.tx_bufs, (size_t)URING_TX_NUM * ur.tx_stride);
+		ur.tx_bufs = NULL;
+	}
+}
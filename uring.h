@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PLGET_URING_H
+#define PLGET_URING_H
+
+#include <sys/socket.h>
+
+/* max number of sends in flight, also max tx batch */
+#define URING_TX_NUM		64
+
+/*
+ * io_uring backend, socket is registered as fixed file. Rx is done with
+ * multishot recvmsg to provided buffer ring, tx with sends from registered
+ * buffers. Ring is used either for rx or for tx, not for both.
+ */
+int uring_setup(int sfd, int sqpoll);
+void uring_release(void);
+int uring_fd(void);
+int uring_napi_setup(int busy_poll_us);
+
+int uring_rx_setup(int controllen);
+int uring_rx_wait(int spin);
+int uring_rx_peek(struct msghdr *msg, char **data);
+void uring_rx_done(void);
+
+int uring_tx_setup(int size, struct sockaddr *addr, socklen_t addrlen,
+		   int zc);
+int uring_tx_send(const char *pkt, int submit);
+int uring_tx_flush(void);
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include <limits.h>
+#include "vec.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#include <arm_neon.h>
+#endif
+
+static inline size_t vec_num(size_t n, int gap)
+{
+	return gap && n ? n - 1 : n;
+}
+
+static inline __u64 vec_val(const __u64 *v, size_t i, int gap)
+{
+	return gap ? v[i + 1] - v[i] : v[i];
+}
+
+static size_t vec_diff_sw(__u64 *res, const __u64 *a, const __u64 *b,
+			  size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n && a[i] && b[i]; i++)
+		res[i] = a[i] - b[i];
+
+	return i;
+}
+
+/* add values from i on to summary of ones before */
+static void vec_sum_tail(const __u64 *v, size_t i, size_t num, int gap,
+			 struct vec_sum *s)
+{
+	__u64 x;
+
+	for (; i < num; i++) {
+		x = vec_val(v, i, gap);
+		s->sum += x;
+		if (x < s->min) {
+			s->min = x;
+			s->min_n = i;
+		}
+
+		if (x > s->max) {
+			s->max = x;
+			s->max_n = i;
+		}
+	}
+}
+
+static void vec_sum_sw(const __u64 *v, size_t n, int gap, struct vec_sum *s)
+{
+	size_t num = vec_num(n, gap);
+
+	memset(s, 0, sizeof(*s));
+	if (!num)
+		return;
+
+	s->min = s->max = s->sum = vec_val(v, 0, gap);
+	vec_sum_tail(v, 1, num, gap, s);
+}
+
+/* fold per lane results of simd kernel, first index wins on equal values */
+static inline void vec_sum_lanes(struct vec_sum *s, const __u64 *mn,
+				 const __u64 *imn, const __u64 *mx,
+				 const __u64 *imx, int lanes)
+{
+	int l;
+
+	s->min = mn[0];
+	s->min_n = imn[0];
+	s->max = mx[0];
+	s->max_n = imx[0];
+	for (l = 1; l < lanes; l++) {
+		if (mn[l] < s->min || (mn[l] == s->min && imn[l] < s->min_n)) {
+			s->min = mn[l];
+			s->min_n = imn[l];
+		}
+
+		if (mx[l] > s->max || (mx[l] == s->max && imx[l] < s->max_n)) {
+			s->max = mx[l];
+			s->max_n = imx[l];
+		}
+	}
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static size_t vec_diff_hw(__u64 *res, const __u64 *a, const __u64 *b,
+			  size_t n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i va, vb, z;
+	size_t i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		va = _mm256_loadu_si256((const __m256i *)(a + i));
+		vb = _mm256_loadu_si256((const __m256i *)(b + i));
+		z = _mm256_or_si256(_mm256_cmpeq_epi64(va, zero),
+				    _mm256_cmpeq_epi64(vb, zero));
+		if (!_mm256_testz_si256(z, z))
+			break;
+
+		_mm256_storeu_si256((__m256i *)(res + i),
+				    _mm256_sub_epi64(va, vb));
+	}
+
+	return i + vec_diff_sw(res + i, a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i vec_ld(const __u64 *v, size_t i, int gap)
+{
+	__m256i x = _mm256_loadu_si256((const __m256i *)(v + i));
+
+	if (!gap)
+		return x;
+
+	return _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)
+						   (v + i + 1)), x);
+}
+
+__attribute__((target("avx2")))
+static void vec_sum_hw(const __u64 *v, size_t n, int gap, struct vec_sum *s)
+{
+	/* there is no unsigned compare, so sign bit is flipped for signed */
+	const __m256i sign = _mm256_set1_epi64x(LLONG_MIN);
+	const __m256i step = _mm256_set1_epi64x(4);
+	__m256i x, xs, m, sum, mn, mx, imn, imx, idx;
+	__u64 lmn[4], limn[4], lmx[4], limx[4], lsum[4];
+	size_t i, num = vec_num(n, gap);
+
+	if (num < 8) {
+		vec_sum_sw(v, n, gap, s);
+		return;
+	}
+
+	x = vec_ld(v, 0, gap);
+	sum = x;
+	mn = mx = _mm256_xor_si256(x, sign);
+	idx = imn = imx = _mm256_set_epi64x(3, 2, 1, 0);
+	for (i = 4; i + 4 <= num; i += 4) {
+		x = vec_ld(v, i, gap);
+		xs = _mm256_xor_si256(x, sign);
+		sum = _mm256_add_epi64(sum, x);
+		idx = _mm256_add_epi64(idx, step);
+
+		m = _mm256_cmpgt_epi64(mn, xs);
+		mn = _mm256_blendv_epi8(mn, xs, m);
+		imn = _mm256_blendv_epi8(imn, idx, m);
+
+		m = _mm256_cmpgt_epi64(xs, mx);
+		mx = _mm256_blendv_epi8(mx, xs, m);
+		imx = _mm256_blendv_epi8(imx, idx, m);
+	}
+
+	_mm256_storeu_si256((__m256i *)lmn, _mm256_xor_si256(mn, sign));
+	_mm256_storeu_si256((__m256i *)lmx, _mm256_xor_si256(mx, sign));
+	_mm256_storeu_si256((__m256i *)limn, imn);
+	_mm256_storeu_si256((__m256i *)limx, imx);
+	_mm256_storeu_si256((__m256i *)lsum, sum);
+
+	vec_sum_lanes(s, lmn, limn, lmx, limx, 4);
+	s->sum = lsum[0] + lsum[1] + lsum[2] + lsum[3];
+	vec_sum_tail(v, i, num, gap, s);
+}
+
+static int vec_hw_present(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+#define VEC_HW_NAME			"avx2"
+#elif defined(__aarch64__)
+static size_t vec_diff_hw(__u64 *res, const __u64 *a, const __u64 *b,
+			  size_t n)
+{
+	uint64x2_t va, vb, z;
+	size_t i;
+
+	for (i = 0; i + 2 <= n; i += 2) {
+		va = vld1q_u64(a + i);
+		vb = vld1q_u64(b + i);
+		z = vorrq_u64(vceqzq_u64(va), vceqzq_u64(vb));
+		if (vmaxvq_u32(vreinterpretq_u32_u64(z)))
+			break;
+
+		vst1q_u64(res + i, vsubq_u64(va, vb));
+	}
+
+	return i + vec_diff_sw(res + i, a + i, b + i, n - i);
+}
+
+static inline uint64x2_t vec_ld(const __u64 *v, size_t i, int gap)
+{
+	uint64x2_t x = vld1q_u64(v + i);
+
+	if (!gap)
+		return x;
+
+	return vsubq_u64(vld1q_u64(v + i + 1), x);
+}
+
+static void vec_sum_hw(const __u64 *v, size_t n, int gap, struct vec_sum *s)
+{
+	static const __u64 lane_idx[2] = {0, 1};
+	const uint64x2_t step = vdupq_n_u64(2);
+	uint64x2_t x, m, sum, mn, mx, imn, imx, idx;
+	__u64 lmn[2], limn[2], lmx[2], limx[2];
+	size_t i, num = vec_num(n, gap);
+
+	if (num < 4) {
+		vec_sum_sw(v, n, gap, s);
+		return;
+	}
+
+	x = vec_ld(v, 0, gap);
+	sum = mn = mx = x;
+	idx = imn = imx = vld1q_u64(lane_idx);
+	for (i = 2; i + 2 <= num; i += 2) {
+		x = vec_ld(v, i, gap);
+		sum = vaddq_u64(sum, x);
+		idx = vaddq_u64(idx, step);
+
+		m = vcltq_u64(x, mn);
+		mn = vbslq_u64(m, x, mn);
+		imn = vbslq_u64(m, idx, imn);
+
+		m = vcgtq_u64(x, mx);
+		mx = vbslq_u64(m, x, mx);
+		imx = vbslq_u64(m, idx, imx);
+	}
+
+	vst1q_u64(lmn, mn);
+	vst1q_u64(limn, imn);
+	vst1q_u64(lmx, mx);
+	vst1q_u64(limx, imx);
+
+	vec_sum_lanes(s, lmn, limn, lmx, limx, 2);
+	s->sum = vaddvq_u64(sum);
+	vec_sum_tail(v, i, num, gap, s);
+}
+
+static int vec_hw_present(void)
+{
+	return !!(getauxval(AT_HWCAP) & HWCAP_ASIMD);
+}
+
+#define VEC_HW_NAME			"asimd"
+#else
+#define vec_diff_hw			vec_diff_sw
+#define vec_sum_hw			vec_sum_sw
+
+static int vec_hw_present(void)
+{
+	return 0;
+}
+
+#define VEC_HW_NAME			"scalar"
+#endif
+
+static size_t (*vec_diff_fn)(__u64 *res, const __u64 *a, const __u64 *b,
+			     size_t n) = vec_diff_sw;
+static void (*vec_sum_fn)(const __u64 *v, size_t n, int gap,
+			  struct vec_sum *s) = vec_sum_sw;
+
+const char *vec_init(void)
+{
+	if (vec_hw_present()) {
+		vec_diff_fn = vec_diff_hw;
+		vec_sum_fn = vec_sum_hw;
+		return VEC_HW_NAME;
+	}
+
+	vec_diff_fn = vec_diff_sw;
+	vec_sum_fn = vec_sum_sw;
+	return "scalar";
+}
+
+size_t vec_diff(__u64 *res, const __u64 *a, const __u64 *b, size_t n)
+{
+	return vec_diff_fn(res, a, b, n);
+}
+
+void vec_sum(const __u64 *v, size_t n, int gap, struct vec_sum *s)
+{
+	vec_sum_fn(v, n, gap, s);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2019
+ * Authors:	Ivan Khoronzhuk <ivan.khoronzhuk@linaro.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PLGET_VEC_H
+#define PLGET_VEC_H
+
+#include <linux/types.h>
+#include <stddef.h>
+
+/* min and max with index of first one of them and sum of values */
+struct vec_sum {
+	__u64 min;
+	__u64 max;
+	__u64 sum;
+	size_t min_n;
+	size_t max_n;
+};
+
+/*
+ * Select kernels for arrays of ns timestamps, simd ones are used if cpu
+ * has them (avx2 on x86, asimd on arm64), otherwise scalar ones.
+ * Returns name of selected ones.
+ */
+const char *vec_init(void);
+
+/* res = a - b, up to first zero entry in a or b, returns number of entries */
+size_t vec_diff(__u64 *res, const __u64 *a, const __u64 *b, size_t n);
+
+/* summary of n values, or of n - 1 gaps between neighbours if gap is set */
+void vec_sum(const __u64 *v, size_t n, int gap, struct vec_sum *s);
+
+#endif
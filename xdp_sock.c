@@ -470,53 +470,98 @@ int xsk_recvmsg_start(struct timespec *ts)
 		fds.fd = plget->sfd;
 		fds.events = POLLIN;
 
-		ret = poll(&fds, 1, -1);
-		if (ret <= 0)
-			return perror("Some error on poll()"), -errno;
+		if (poll(&fds, 1, -1) < 0) {
+			if (errno != EINTR)
+				perror("Some error on poll()");
+
+			return -1;
+		}
 	}
 
 	do
 		ret = rq_deq(&xsk->rq, desc, 1);
-	while (!ret && plget->flags & PLF_SW_POLL);
+	while (!ret && plget->flags & PLF_SW_POLL && !plget->rx_idle);
 
 	plget->rx_pkt = umem_get_data(xsk, desc->addr);
 	clock_gettime(CLOCK_REALTIME, ts);
 
 	if (!ret)
-		return -1;
+		return errno = EAGAIN, -1;
 
 	return desc->len;
 }
 
-static void xsk_create_msg(struct msghdr *msg)
+/* metadata before frame keeps h/w and s/w ns timestamps put by xdp prog */
+static inline void xsk_meta_ts(const char *data, __u64 *sw, __u64 *hw)
+{
+	memcpy(hw, data - 2 * sizeof(__u64), sizeof(*hw));
+	memcpy(sw, data - sizeof(__u64), sizeof(*sw));
+}
+
+/* h/w timestamp if present or s/w one, returns 1 if it's h/w one */
+static int xsk_get_ts(const char *data, __u64 *ts)
 {
-	struct scm_timestamping *tss;
-	struct timespec *ts1;
-	struct cmsghdr *cmsg;
-	char *data;
-	__u64 ns;
+	__u64 hw_ns, sw_ns;
+
+	xsk_meta_ts(data, &sw_ns, &hw_ns);
+	*ts = hw_ns ? hw_ns : sw_ns;
+	return !!hw_ns;
+}
 
-	data = plget->rx_pkt - 2 * sizeof(ns);
+/*
+ * Dequeue up to num rx descriptors at once, frames stay owned by user
+ * till xsk_release_frames() is called. If xdp prog puts no timestamps,
+ * app ts of batch is the s/w one.
+ */
+int xsk_recv_frames(struct rx_frame *frames, int num)
+{
+	struct xsock *xsk = plget->xsk;
+	struct xdp_desc *desc;
+	struct timespec ts;
+	__u64 now = 0;
+	__u32 i;
+
+	if (num > XSK_RX_BATCH)
+		num = XSK_RX_BATCH;
+
+	xsk->rx_num = rq_deq(&xsk->rq, xsk->rx_descs, num);
+	for (i = 0; i < xsk->rx_num; i++) {
+		desc = &xsk->rx_descs[i];
+		frames[i].data = umem_get_data(xsk, desc->addr);
+		frames[i].snaplen = desc->len;
+		frames[i].len = desc->len;
+		frames[i].hw = xsk_get_ts(frames[i].data, &frames[i].ts);
+		if (frames[i].ts)
+			continue;
+
+		if (!now) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			now = ts_ns(&ts);
+		}
+
+		frames[i].ts = now;
+	}
 
-	cmsg = msg->msg_control;
-	cmsg->cmsg_len =
-		sizeof(struct cmsghdr) + sizeof(struct scm_timestamping);
+	return xsk->rx_num;
+}
 
-	cmsg->cmsg_level = SOL_SOCKET;
-	cmsg->cmsg_type = SCM_TIMESTAMPING;
-	tss = (struct scm_timestamping *)CMSG_DATA(cmsg);
+/* give whole batch back to fill queue, frames are lost if it's full */
+int xsk_release_frames(void)
+{
+	struct xsock *xsk = plget->xsk;
+	int ret;
 
-	memcpy(&ns, data, sizeof(ns));
-	ts1 = &tss->ts[2];
-	ts1->tv_sec = ns / NSEC_PER_SEC;
-	ts1->tv_nsec = ns - ts1->tv_sec * NSEC_PER_SEC;
+	if (!xsk->rx_num)
+		return 0;
 
-	memcpy(&ns, data + sizeof(ns), sizeof(ns));
-	ts1 = tss->ts;
-	ts1->tv_sec = ns / NSEC_PER_SEC;
-	ts1->tv_nsec = ns - ts1->tv_sec * NSEC_PER_SEC;
+	ret = fq_enq(&xsk->umem->fq, xsk->rx_descs, xsk->rx_num);
+	xsk->rx_num = 0;
+	if (ret) {
+		errno = -ret;
+		return perror("Cannot refill fill queue"), ret;
+	}
 
-	msg->msg_controllen = CMSG_ALIGN(cmsg->cmsg_len);
+	return 0;
 }
 
 void xsk_recvmsg_fail(void)
@@ -526,11 +571,19 @@ void xsk_recvmsg_fail(void)
 	fq_enq(&xsk->umem->fq, &xsk->desc, 1);
 }
 
-void xsk_recvmsg_complete(struct msghdr *msg)
+/* ns timestamps of last packet, kept by xsk_recvmsg_complete() */
+void xsk_recvmsg_ts(__u64 *sw, __u64 *hw)
+{
+	*sw = plget->xsk->rx_sw;
+	*hw = plget->xsk->rx_hw;
+}
+
+void xsk_recvmsg_complete(void)
 {
 	struct xsock *xsk = plget->xsk;
 
-	xsk_create_msg(msg);
+	/* frame can be refilled, so metadata is read before */
+	xsk_meta_ts(plget->rx_pkt, &xsk->rx_sw, &xsk->rx_hw);
 
 	if (plget->mod != ECHO_LAT)
 		fq_enq(&xsk->umem->fq, &xsk->desc, 1);
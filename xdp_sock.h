@@ -16,11 +16,13 @@
 #define PLGET_XDP_SOCK_H
 
 #include "plget.h"
+#include "rx_ring.h"
 
 #define FRAME_SHIFT	11
 #define FRAME_SIZE	(1 << FRAME_SHIFT)	/* 2 frames per page */
 #define FRAME_NUM	256	/* number of frames to operate on */
 #define FRAME_HEADROOM	0
+#define XSK_RX_BATCH	64	/* max number of rx descs dequeued at once */
 
 typedef __u64 umem_desc;
 typedef struct xdp_desc sock_desc;
@@ -48,6 +50,10 @@ struct xsock {
 	struct queue tq;
 	struct sock_umem *umem;
 	struct xdp_desc desc; /* desc for rolling in echo-lat mode */
+	struct xdp_desc rx_descs[XSK_RX_BATCH];	/* last dequeued batch */
+	__u32 rx_num;
+	__u64 rx_sw;		/* ns timestamps of last xsk_recvmsg packet */
+	__u64 rx_hw;
 	int sfd;
 };
 
@@ -57,7 +63,10 @@ int xdp_socket(void);
 int xsk_sendto(void);
 int xsk_recvmsg_start(struct timespec *ts);
 void xsk_recvmsg_fail(void);
-void xsk_recvmsg_complete(struct msghdr *msg);
+void xsk_recvmsg_ts(__u64 *sw, __u64 *hw);
+void xsk_recvmsg_complete(void);
+int xsk_recv_frames(struct rx_frame *frames, int num);
+int xsk_release_frames(void);
 
 #else
 inline static int xdp_socket(void)
@@ -79,8 +88,23 @@ inline static void xsk_recvmsg_fail(void)
 {
 }
 
-inline static void xsk_recvmsg_complete(struct msghdr *msg)
+inline static void xsk_recvmsg_ts(__u64 *sw, __u64 *hw)
 {
+	*sw = *hw = 0;
+}
+
+inline static void xsk_recvmsg_complete(void)
+{
+}
+
+inline static int xsk_recv_frames(struct rx_frame *frames, int num)
+{
+	return 0;
+}
+
+inline static int xsk_release_frames(void)
+{
+	return 0;
 }
 
 #endif